@@ -2,12 +2,16 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct kmem_cache;
 struct pipe;
+struct shm;
 struct proc;
+struct seg;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct vma;
 
 // bio.c
 void            binit(void);
@@ -24,6 +28,8 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+struct seg*     seglookup(struct proc*, uint64);
+char*           loadpage(struct proc*, struct seg*, uint64);
 
 // file.c
 struct file*    filealloc(void);
@@ -53,6 +59,7 @@ int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
+void            itextfree(struct inode*);
 
 // ramdisk.c
 void            ramdiskinit(void);
@@ -63,6 +70,13 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            kallocdump(void);
+void*           kalloc_zeroed(void);
+void*           kallocpages(int);
+void            kfreepages(void *, int);
+void            kref(uint64);
+int             krefcount(uint64);
+void            kzerofill(void);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -70,7 +84,21 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// mmap.c
+uint64          mmap(uint64, uint64, int, int);
+int             munmap(uint64, uint64);
+int             madvise(uint64, uint64, int);
+uint64          mremap(uint64, uint64, uint64, int);
+int             pagefault(struct proc*, uint64);
+uint64          mmapfloor(struct proc*);
+uint64          mmapfind(struct proc*, uint64, uint64);
+struct vma*     mmaplookup(struct proc*, uint64);
+void            prefault(uint64, uint64);
+int             mmapcopy(struct proc*, struct proc*);
+void            mmapfree(struct proc*, pagetable_t);
+
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
@@ -118,6 +146,22 @@ void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 
+// shm.c
+void            shminit(void);
+int             shmget(int, uint64, int);
+uint64          shmat(int, uint64, int);
+int             shmdt(uint64);
+int             shmctl(int, int, uint64);
+void            shmdup(struct shm*);
+void            shmdrop(struct shm*);
+
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+void            slabdump(void);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -160,14 +204,20 @@ void            kvminit(void);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
+int             mapmegapages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvmfirst(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcopyrange(pagetable_t, pagetable_t, uint64, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+void            uvmdiscard(pagetable_t, uint64, uint64);
+int             uvmmove(pagetable_t, uint64, uint64, uint64);
+int             uvmcow(pagetable_t, uint64);
+int             uvmshare(pagetable_t, pagetable_t, uint64, uint64);
 pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
@@ -6,8 +6,9 @@
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
-
-static int loadseg(pde_t *, uint64, struct inode *, uint, uint);
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 
 int flags2perm(int flags)
 {
@@ -26,8 +27,10 @@ exec(char *path, char **argv)
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exe = 0, *oldexe;
   struct proghdr ph;
+  struct seg seg[NSEG];
+  int nseg = 0;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
@@ -49,7 +52,9 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program segments. Their pages are read in
+  // by pagefault() when the program first touches them.
+  memset(seg, 0, sizeof(seg));
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -59,17 +64,27 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if(ph.vaddr % PGSIZE != 0)
+    if(ph.vaddr % PGSIZE != 0 || ph.vaddr + ph.memsz > MMAPTOP)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz, flags2perm(ph.flags))) == 0)
+    if(ph.off + ph.filesz < ph.off || ph.off + ph.filesz > ip->size)
       goto bad;
-    sz = sz1;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(ph.memsz == 0)
+      continue;
+    if(nseg == NSEG)
       goto bad;
+    seg[nseg].va = ph.vaddr;
+    seg[nseg].end = ph.vaddr + ph.memsz;
+    seg[nseg].off = ph.off;
+    seg[nseg].filesz = ph.filesz;
+    seg[nseg].perm = flags2perm(ph.flags);
+    nseg++;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
-  iunlockput(ip);
+  // keep the inode for pagefault, unlocked.
+  iunlock(ip);
   end_op();
+  exe = ip;
   ip = 0;
 
   p = myproc();
@@ -122,11 +137,20 @@ exec(char *path, char **argv)
     
   // Commit to the user image.
   oldpagetable = p->pagetable;
+  oldexe = p->exe;
   p->pagetable = pagetable;
   p->sz = sz;
+  p->exe = exe;
+  memmove(p->seg, seg, sizeof(seg));
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
+  mmapfree(p, oldpagetable);
   proc_freepagetable(oldpagetable, oldsz);
+  if(oldexe){
+    begin_op();
+    iput(oldexe);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -137,30 +161,78 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
+  if(exe){
+    begin_op();
+    iput(exe);
+    end_op();
+  }
   return -1;
 }
 
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
+// Find the program segment of p that holds va, or 0.
+struct seg*
+seglookup(struct proc *p, uint64 va)
 {
-  uint i, n;
-  uint64 pa;
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
-  }
-  
+  if(p->exe == 0)
+    return 0;
+  for(struct seg *s = p->seg; s < &p->seg[NSEG]; s++)
+    if(s->end && s->va <= va && va < s->end)
+      return s;
   return 0;
 }
+
+// Get the page at va of segment s of p: the bytes of the
+// executable, zero past filesz. va must be page-aligned.
+// Pages of read-only segments are cached in the inode and
+// shared by every process that runs it, while any process
+// runs it.
+// Returns the page, with a reference for the caller, or 0.
+char*
+loadpage(struct proc *p, struct seg *s, uint64 va)
+{
+  struct inode *ip = p->exe;
+  uint64 i = va - s->va, pg = (s->off + i) / PGSIZE;
+  uint n;
+  int spin, share;
+  char *mem;
+
+  if(i >= s->filesz)
+    return kalloc_zeroed(); // all bss
+  n = s->filesz - i < PGSIZE ? s->filesz - i : PGSIZE;
+  // the cache is indexed by page of the file, so the segment
+  // must start on one. programs linked with user.ld do: ld
+  // (-z max-page-size=4096) keeps off = vaddr mod PGSIZE, and
+  // vaddr is page-aligned. those linked with -N, such as
+  // forktest, are one writable segment and are not shared.
+  share = (s->perm & PTE_W) == 0 && s->off % PGSIZE == 0 && pg < NTEXT;
+
+  // reading the file sleeps and locks the executable, which
+  // a copyin or copyout under a spinlock cannot do, nor one
+  // under a sleep-lock, which may be another inode's lock
+  // and deadlock. the copies made under a lock are those of
+  // fileread and filewrite (pipes, devices, readi, writei)
+  // and of wait, and these prefault() first. the others
+  // (fetchaddr, fetchstr, filestat, shmctl, sys_pipe) copy
+  // with no lock held, and load their pages here.
+  push_off();
+  spin = mycpu()->noff > 1;
+  pop_off();
+  if(spin || p->nsleeplock > 0)
+    return 0;
+
+  ilock(ip);
+  if(share && ip->text && ip->text[pg]){
+    mem = (char*)ip->text[pg];
+    kref((uint64)mem);
+  } else if((mem = kalloc_zeroed()) != 0){
+    if(readi(ip, 0, (uint64)mem, s->off + i, n) != n){
+      kfree(mem);
+      mem = 0;
+    } else if(share && (ip->text || (ip->text = kalloc_zeroed()) != 0)){
+      ip->text[pg] = (uint64)mem;
+      kref((uint64)mem);
+    }
+  }
+  iunlock(ip);
+  return mem;
+}
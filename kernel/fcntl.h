@@ -3,3 +3,14 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+
+#define PROT_READ     0x1
+#define PROT_WRITE    0x2
+#define PROT_EXEC     0x4
+
+#define MAP_PRIVATE   0x02
+#define MAP_ANONYMOUS 0x20
+
+#define MADV_DONTNEED 4
+
+#define MREMAP_MAYMOVE 1
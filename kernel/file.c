@@ -110,6 +110,8 @@ fileread(struct file *f, uint64 addr, int n)
 
   if(f->readable == 0)
     return -1;
+  if(n > 0)
+    prefault(addr, n); // the copies below run under locks
 
   if(f->type == FD_PIPE){
     r = piperead(f->pipe, addr, n);
@@ -138,6 +140,8 @@ filewrite(struct file *f, uint64 addr, int n)
 
   if(f->writable == 0)
     return -1;
+  if(n > 0)
+    prefault(addr, n); // the copies below run under locks
 
   if(f->type == FD_PIPE){
     ret = pipewrite(f->pipe, addr, n);
@@ -27,8 +27,11 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+  uint64 *text;       // read-only program pages, while it runs; see loadpage()
 };
 
+#define NTEXT 512     // file pages in a text cache, one page of addresses
+
 // map major device number to device functions.
 struct devsw {
   int (*read)(int, uint64, int);
@@ -357,6 +357,10 @@ iput(struct inode *ip)
     acquire(&itable.lock);
   }
 
+  // no process runs the program any more; let its pages go.
+  if(ip->ref == 1)
+    itextfree(ip);
+
   ip->ref--;
   release(&itable.lock);
 }
@@ -369,6 +373,22 @@ iunlockput(struct inode *ip)
   iput(ip);
 }
 
+// Drop the program pages that loadpage() cached for ip,
+// because its contents change or its last reference goes.
+// Processes that map the pages keep their own references.
+// Caller holds ip->lock, or itable.lock and the last reference.
+void
+itextfree(struct inode *ip)
+{
+  if(ip->text == 0)
+    return;
+  for(int i = 0; i < NTEXT; i++)
+    if(ip->text[i])
+      kfree((void*)ip->text[i]);
+  kfree((void*)ip->text);
+  ip->text = 0;
+}
+
 // Inode content
 //
 // The content (data) associated with each inode is stored
@@ -429,6 +449,8 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  itextfree(ip);
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -512,6 +534,7 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
+  itextfree(ip);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     uint addr = bmap(ip, off/BSIZE);
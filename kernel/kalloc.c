@@ -1,6 +1,27 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
 // and pipe buffers. Allocates whole 4096-byte pages.
+//
+// Each CPU keeps its own free list, so that most calls
+// to kalloc and kfree take only that CPU's lock. The lists
+// refill from and spill to a global pool KBATCH pages at a
+// time. A CPU that finds both its list and the pool empty
+// steals half of another CPU's list.
+//
+// The pool is a buddy allocator: free blocks of 2^order
+// pages, aligned to their size, sit on one list per order,
+// and a freed block merges with its free buddy. kallocpages
+// hands out physically contiguous blocks of up to 2 MB.
+//
+// Pages are filled with junk on kfree and kalloc only when
+// built with KALLOC_DEBUG (make KDEBUG=1). Idle harts keep a
+// pool of zeroed pages for kalloc_zeroed, while memory is
+// plentiful; when the buddy pool runs dry, the zeroed pages
+// go back into it, where they can merge again.
+//
+// Each page has a reference count, so that fork can share
+// pages copy-on-write. kfree frees a page when its last
+// reference goes.
 
 #include "types.h"
 #include "param.h"
@@ -9,6 +30,10 @@
 #include "riscv.h"
 #include "defs.h"
 
+#define KBATCH 32  // pages moved to or from the pool at a time
+#define KZERO  256 // zeroed pages kept by idle harts
+#define NORDER 10  // block sizes from PGSIZE to MEGAPGSIZE
+
 void freerange(void *pa_start, void *pa_end);
 
 extern char end[]; // first address after kernel.
@@ -16,17 +41,52 @@ extern char end[]; // first address after kernel.
 
 struct run {
   struct run *next;
+  struct run *prev; // only on the buddy lists
 };
 
+// The global pool.
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct run *free[NORDER]; // free blocks of each order
+  int nblock[NORDER];
+  int nfree;                // pages in all the blocks
 } kmem;
 
+// Pages zeroed ahead of time.
+struct {
+  struct spinlock lock;
+  struct run *freelist;
+  int nfree;
+} kzero;
+
+// References to each page, indexed by PA2REF.
+#define PA2REF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+int krefs[PA2REF(PHYSTOP)];
+
+// For a page that starts a free block in the pool, the
+// block's order plus one; otherwise 0.
+uchar korder[PA2REF(PHYSTOP)];
+
+struct kcpu {
+  struct spinlock lock;
+  struct run *freelist;
+  int nfree;
+
+  // statistics, for kallocdump.
+  uint64 nalloc;
+  uint64 nkfree;
+  uint64 nrefill;
+  uint64 nspill;
+  uint64 nsteal;
+} kcpus[NCPU];
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  initlock(&kzero.lock, "kzero");
+  for(struct kcpu *kc = kcpus; kc < &kcpus[NCPU]; kc++)
+    initlock(&kc->lock, "kcpu");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,8 +95,194 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    krefs[PA2REF(p)] = 1;
     kfree(p);
+  }
+}
+
+// Put the block r of the given order on its pool list.
+// The caller holds kmem.lock.
+static void
+bpush(struct run *r, int order)
+{
+  r->prev = 0;
+  r->next = kmem.free[order];
+  if(r->next)
+    r->next->prev = r;
+  kmem.free[order] = r;
+  kmem.nblock[order]++;
+  kmem.nfree += 1 << order;
+  korder[PA2REF(r)] = order + 1;
+}
+
+// Take the block r of the given order off its pool list.
+// The caller holds kmem.lock.
+static void
+bremove(struct run *r, int order)
+{
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.free[order] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  kmem.nblock[order]--;
+  kmem.nfree -= 1 << order;
+  korder[PA2REF(r)] = 0;
+}
+
+// Allocate a block of 2^order pages from the pool,
+// splitting a larger block if need be. Returns 0 if
+// there is none. The caller holds kmem.lock.
+static struct run*
+balloc(int order)
+{
+  struct run *r;
+  int k;
+
+  for(k = order; k < NORDER && kmem.free[k] == 0; k++)
+    ;
+  if(k == NORDER)
+    return 0;
+  r = kmem.free[k];
+  bremove(r, k);
+  while(k > order){
+    k--;
+    bpush((struct run*)((char*)r + ((uint64)PGSIZE << k)), k);
+  }
+  return r;
+}
+
+// Return the block at pa of 2^order pages to the pool,
+// merging it with its buddy for as long as the buddy is
+// free too. The caller holds kmem.lock.
+static void
+bfree(void *pa, int order)
+{
+  uint64 i, b;
+
+  for(i = PA2REF(pa); order < NORDER-1; order++){
+    b = i ^ (1L << order);
+    if(b >= PA2REF(PHYSTOP) || korder[b] != order + 1)
+      break;
+    bremove((struct run*)(KERNBASE + b*PGSIZE), order);
+    if(b < i)
+      i = b;
+  }
+  bpush((struct run*)(KERNBASE + i*PGSIZE), order);
+}
+
+// Take up to n pages off the front of *list.
+// Returns the first page, with the last one in *tail
+// and the count in *count. The caller holds the lock.
+static struct run*
+ktake(struct run **list, int n, struct run **tail, int *count)
+{
+  struct run *head = *list, *r = 0;
+  int i;
+
+  for(i = 0; i < n && *list; i++){
+    r = *list;
+    *list = r->next;
+  }
+  if(r)
+    r->next = 0;
+  *tail = r;
+  *count = i;
+  return i ? head : 0;
+}
+
+// Give all the zeroed pages back to the buddy pool.
+// Returns how many there were.
+static int
+kzerodrain(void)
+{
+  struct run *r, *next;
+  int n;
+
+  acquire(&kzero.lock);
+  r = kzero.freelist;
+  n = kzero.nfree;
+  kzero.freelist = 0;
+  kzero.nfree = 0;
+  release(&kzero.lock);
+
+  if(r == 0)
+    return 0;
+  acquire(&kmem.lock);
+  for(; r; r = next){
+    next = r->next;
+    krefs[PA2REF(r)] = 0;
+    bfree(r, 0);
+  }
+  release(&kmem.lock);
+  return n;
+}
+
+// Refill the empty list of kc from the pool, or failing
+// that, from the zeroed pages or another CPU. Called with
+// interrupts off and without kc->lock, so that no two kcpu
+// locks are held.
+static void
+krefill(struct kcpu *kc)
+{
+  struct run *head = 0, *tail = 0, *r;
+  int n, steal = 0;
+
+ again:
+  acquire(&kmem.lock);
+  for(n = 0; n < KBATCH && (r = balloc(0)) != 0; n++){
+    r->next = head;
+    head = r;
+    if(tail == 0)
+      tail = r;
+  }
+  release(&kmem.lock);
+  if(head == 0 && kzerodrain() > 0)
+    goto again;
+
+  for(struct kcpu *v = kcpus; head == 0 && v < &kcpus[NCPU]; v++){
+    if(v == kc)
+      continue;
+    acquire(&v->lock);
+    head = ktake(&v->freelist, (v->nfree + 1) / 2, &tail, &n);
+    v->nfree -= n;
+    release(&v->lock);
+    steal = 1;
+  }
+  if(head == 0)
+    return;
+
+  acquire(&kc->lock);
+  tail->next = kc->freelist;
+  kc->freelist = head;
+  kc->nfree += n;
+  if(steal)
+    kc->nsteal++;
+  else
+    kc->nrefill++;
+  release(&kc->lock);
+}
+
+// Take a page from the zeroed pool, or return 0.
+// Its link word is cleared again before it is handed out.
+static void*
+kzerotake(void)
+{
+  struct run *r;
+
+  acquire(&kzero.lock);
+  r = kzero.freelist;
+  if(r){
+    kzero.freelist = r->next;
+    kzero.nfree--;
+  }
+  release(&kzero.lock);
+
+  if(r)
+    r->next = 0;
+  return (void*)r;
 }
 
 // Free the page of physical memory pointed at by pa,
@@ -46,20 +292,50 @@ freerange(void *pa_start, void *pa_end)
 void
 kfree(void *pa)
 {
-  struct run *r;
+  struct run *r, *head = 0, *tail;
+  struct kcpu *kc;
+  int n;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  int ref = __sync_sub_and_fetch(&krefs[PA2REF(pa)], 1);
+  if(ref > 0)
+    return;
+  if(ref < 0)
+    panic("kfree: ref");
+
+#ifdef KALLOC_DEBUG
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  kc = &kcpus[cpuid()];
+  acquire(&kc->lock);
+  r->next = kc->freelist;
+  kc->freelist = r;
+  kc->nfree++;
+  kc->nkfree++;
+  if(kc->nfree >= 2*KBATCH){
+    head = ktake(&kc->freelist, KBATCH, &tail, &n);
+    kc->nfree -= n;
+    kc->nspill++;
+  }
+  release(&kc->lock);
+
+  if(head){
+    acquire(&kmem.lock);
+    while(head){
+      r = head;
+      head = r->next;
+      bfree(r, 0);
+    }
+    release(&kmem.lock);
+  }
+  pop_off();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -69,14 +345,159 @@ void *
 kalloc(void)
 {
   struct run *r;
+  struct kcpu *kc;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  kc = &kcpus[cpuid()];
+  acquire(&kc->lock);
+  if(kc->freelist == 0){
+    release(&kc->lock);
+    krefill(kc);
+    acquire(&kc->lock);
+  }
+  r = kc->freelist;
+  if(r){
+    kc->freelist = r->next;
+    kc->nfree--;
+    kc->nalloc++;
+  }
+  release(&kc->lock);
+  pop_off();
 
+#ifdef KALLOC_DEBUG
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
+  if(r == 0)
+    r = kzerotake(); // the zeroed pages are free memory too.
+  if(r)
+    krefs[PA2REF(r)] = 1;
+  return (void*)r;
+}
+
+// Add a reference to the page at pa, for sharing.
+void
+kref(uint64 pa)
+{
+  if((pa % PGSIZE) != 0 || pa < (uint64)end || pa >= PHYSTOP)
+    panic("kref");
+  __sync_fetch_and_add(&krefs[PA2REF(pa)], 1);
+}
+
+// Allocate 2^order physically contiguous pages, aligned to
+// their size, for order < NORDER. Only the first page gets
+// a reference count. Returns 0 if the memory cannot be
+// allocated.
+void *
+kallocpages(int order)
+{
+  struct run *r;
+
+  if(order < 0 || order >= NORDER)
+    panic("kallocpages");
+  if(order == 0)
+    return kalloc();
+
+  acquire(&kmem.lock);
+  r = balloc(order);
+  release(&kmem.lock);
+  if(r == 0 && kzerodrain() > 0){
+    acquire(&kmem.lock);
+    r = balloc(order);
+    release(&kmem.lock);
+  }
+  if(r == 0)
+    return 0;
+#ifdef KALLOC_DEBUG
+  memset((char*)r, 5, (uint64)PGSIZE << order); // fill with junk
+#endif
+  krefs[PA2REF(r)] = 1;
   return (void*)r;
 }
+
+// Free a block returned by kallocpages(order).
+void
+kfreepages(void *pa, int order)
+{
+  if(order < 0 || order >= NORDER)
+    panic("kfreepages");
+  if(order == 0){
+    kfree(pa);
+    return;
+  }
+  if(((uint64)pa % ((uint64)PGSIZE << order)) != 0 || (char*)pa < end ||
+     (uint64)pa >= PHYSTOP)
+    panic("kfreepages");
+  if(__sync_sub_and_fetch(&krefs[PA2REF(pa)], 1) != 0)
+    panic("kfreepages: ref");
+#ifdef KALLOC_DEBUG
+  memset(pa, 1, (uint64)PGSIZE << order);
+#endif
+
+  acquire(&kmem.lock);
+  bfree(pa, order);
+  release(&kmem.lock);
+}
+
+// How many references the page at pa has.
+int
+krefcount(uint64 pa)
+{
+  return __atomic_load_n(&krefs[PA2REF(pa)], __ATOMIC_SEQ_CST);
+}
+
+// Allocate one zeroed 4096-byte page, from the pages
+// zeroed by idle harts if there are any.
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_zeroed(void)
+{
+  char *mem;
+
+  if((mem = (char*)kzerotake()) != 0)
+    return mem;
+  if((mem = kalloc()) != 0)
+    memset(mem, 0, PGSIZE);
+  return mem;
+}
+
+// Zero a few pages into the pool, up to KZERO pages, as
+// long as the buddy pool keeps at least as many free.
+// Called by the scheduler when it has nothing to run.
+void
+kzerofill(void)
+{
+  struct run *r;
+
+  for(int i = 0; i < 8 && kzero.nfree < KZERO && kmem.nfree > KZERO; i++){
+    if((r = (struct run*)kalloc()) == 0)
+      return;
+    memset(r, 0, PGSIZE);
+    acquire(&kzero.lock);
+    r->next = kzero.freelist;
+    kzero.freelist = r;
+    kzero.nfree++;
+    release(&kzero.lock);
+  }
+}
+
+// Print the free pages and statistics of each CPU, and the
+// free blocks of each order in the pool, which show how
+// fragmented it is. Runs from procdump; no lock, like procdump.
+void
+kallocdump(void)
+{
+  printf("kalloc: %d pages in pool, %d zeroed\n", kmem.nfree, kzero.nfree);
+  printf("blocks by order:");
+  for(int k = 0; k < NORDER; k++)
+    printf(" %d", kmem.nblock[k]);
+  printf("\n");
+  for(int i = 0; i < NCPU; i++){
+    struct kcpu *kc = &kcpus[i];
+    if(kc->nalloc == 0 && kc->nkfree == 0)
+      continue;
+    printf("cpu %d: %d free, %d alloc, %d kfree, %d refill, %d spill, %d steal\n",
+           i, kc->nfree, (int)kc->nalloc, (int)kc->nkfree,
+           (int)kc->nrefill, (int)kc->nspill, (int)kc->nsteal);
+  }
+}
@@ -62,6 +62,8 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   anonymous mappings (mmap), growing down from MMAPTOP
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define MMAPTOP   TRAPFRAME
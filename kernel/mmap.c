@@ -0,0 +1,356 @@
+// Anonymous memory mappings.
+//
+// Each process has up to NVMA regions of zero-filled pages,
+// placed top-down from MMAPTOP, above the heap. Unlike sbrk
+// memory, any region can be given back to kalloc on its own,
+// whatever is still in use around it. Shared memory segments
+// (see shm.c) are attached in the same slots and address range.
+//
+// madvise drops the pages behind part of the heap or of a
+// region without unmapping it. pagefault fills such pages,
+// and heap pages that sbrk has only reserved, with zeros
+// when they are first touched, and reads program pages
+// that exec left out from the executable.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fcntl.h"
+#include "defs.h"
+
+// Lowest address in use by a mapping, or MMAPTOP.
+// The heap must not grow beyond it.
+uint64
+mmapfloor(struct proc *p)
+{
+  uint64 floor = MMAPTOP;
+  for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start && v->start < floor)
+      floor = v->start;
+  return floor;
+}
+
+// Is [start, end) free of the heap and all mappings?
+static int
+mmapvacant(struct proc *p, uint64 start, uint64 end)
+{
+  if(start < PGROUNDUP(p->sz) || end > MMAPTOP || start >= end)
+    return 0;
+  for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start && start < v->end && v->start < end)
+      return 0;
+  return 1;
+}
+
+// Find room for len bytes: at the hint addr if it is free,
+// otherwise the highest free range below MMAPTOP.
+// Returns 0 if there is no room.
+uint64
+mmapfind(struct proc *p, uint64 addr, uint64 len)
+{
+  uint64 best = 0;
+
+  if(addr && addr + len > addr && mmapvacant(p, addr, addr + len))
+    return addr;
+
+  // The highest free range ends at MMAPTOP or at the
+  // start of some mapping.
+  if(mmapvacant(p, MMAPTOP - len, MMAPTOP))
+    return MMAPTOP - len;
+  for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == 0 || v->start < len)
+      continue;
+    if(v->start - len > best && mmapvacant(p, v->start - len, v->start))
+      best = v->start - len;
+  }
+  return best;
+}
+
+// Map len bytes of zero-filled memory into the current process.
+// Only MAP_ANONYMOUS is supported.
+// Returns the address, or -1 on error.
+uint64
+mmap(uint64 addr, uint64 len, int prot, int flags)
+{
+  struct proc *p = myproc();
+  struct vma *v, *slot = 0;
+  int perm = 0;
+
+  if(len == 0 || addr % PGSIZE != 0 || (flags & MAP_ANONYMOUS) == 0)
+    return -1;
+  len = PGROUNDUP(len);
+  if(len > MMAPTOP)
+    return -1;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == 0){
+      slot = v;
+      break;
+    }
+  }
+  if(slot == 0)
+    return -1;
+
+  if((addr = mmapfind(p, addr, len)) == 0)
+    return -1;
+
+  // uvmalloc always adds PTE_R, which PTE_W requires anyway.
+  if(prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(prot & PROT_EXEC)
+    perm |= PTE_X;
+  if(uvmalloc(p->pagetable, addr, addr + len, perm) == 0)
+    return -1;
+
+  slot->start = addr;
+  slot->end = addr + len;
+  slot->perm = PTE_R | perm;
+  slot->shm = 0;
+  return addr;
+}
+
+// Unmap the pages from addr to addr+len and give them back
+// to kalloc. The range must lie within one mapping.
+// Returns 0 on success, -1 on error.
+int
+munmap(uint64 addr, uint64 len)
+{
+  struct proc *p = myproc();
+  struct vma *v, *rest;
+  uint64 end;
+
+  if(addr % PGSIZE != 0 || len == 0)
+    return -1;
+  end = PGROUNDUP(addr + len);
+  if(end <= addr)
+    return -1;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start && v->start <= addr && end <= v->end)
+      break;
+  if(v == &p->vma[NVMA] || v->shm)
+    return -1;
+
+  if(v->start < addr && end < v->end){
+    // A hole in the middle splits the mapping in two.
+    for(rest = p->vma; rest < &p->vma[NVMA]; rest++)
+      if(rest->start == 0)
+        break;
+    if(rest == &p->vma[NVMA])
+      return -1;
+    rest->start = end;
+    rest->end = v->end;
+    rest->perm = v->perm;
+    rest->shm = 0;
+    v->end = addr;
+  } else if(v->start < addr){
+    v->end = addr;
+  } else if(end < v->end){
+    v->start = end;
+  } else {
+    v->start = v->end = 0;
+  }
+
+  uvmunmap(p->pagetable, addr, (end - addr) / PGSIZE, 1);
+  return 0;
+}
+
+// Resize the whole mapping at addr from oldlen to newlen bytes.
+// It grows in place if the pages above it are free; otherwise,
+// with MREMAP_MAYMOVE, its pages are moved to a new range by
+// their page-table entries, without copying.
+// Returns the new address, or -1 on error.
+uint64
+mremap(uint64 addr, uint64 oldlen, uint64 newlen, int flags)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint64 newaddr;
+
+  if(addr % PGSIZE != 0 || newlen == 0)
+    return -1;
+  oldlen = PGROUNDUP(oldlen);
+  newlen = PGROUNDUP(newlen);
+  if(newlen > MMAPTOP)
+    return -1;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start == addr && v->end == addr + oldlen)
+      break;
+  if(v == &p->vma[NVMA] || v->shm)
+    return -1;
+
+  if(newlen <= oldlen){
+    if(newlen < oldlen){
+      uvmunmap(p->pagetable, addr + newlen, (oldlen - newlen) / PGSIZE, 1);
+      v->end = addr + newlen;
+    }
+    return addr;
+  }
+
+  if(mmapvacant(p, v->end, addr + newlen)){
+    if(uvmalloc(p->pagetable, v->end, addr + newlen, v->perm & ~PTE_R) == 0)
+      return -1;
+    v->end = addr + newlen;
+    return addr;
+  }
+
+  if((flags & MREMAP_MAYMOVE) == 0)
+    return -1;
+  if((newaddr = mmapfind(p, 0, newlen)) == 0)
+    return -1;
+  if(uvmalloc(p->pagetable, newaddr + oldlen, newaddr + newlen, v->perm & ~PTE_R) == 0)
+    return -1;
+  if(uvmmove(p->pagetable, addr, newaddr, oldlen / PGSIZE) != 0){
+    uvmunmap(p->pagetable, newaddr + oldlen, (newlen - oldlen) / PGSIZE, 1);
+    return -1;
+  }
+  v->start = newaddr;
+  v->end = newaddr + newlen;
+  return newaddr;
+}
+
+// Copy the mappings of p into the child np, for fork.
+// Shared memory segments stay shared.
+// Returns 0 on success, -1 on failure, in which case
+// np holds the mappings copied so far.
+int
+mmapcopy(struct proc *p, struct proc *np)
+{
+  for(int i = 0; i < NVMA; i++){
+    struct vma *v = &p->vma[i];
+    if(v->start == 0)
+      continue;
+    if(v->shm){
+      if(uvmshare(p->pagetable, np->pagetable, v->start, v->end) < 0)
+        return -1;
+      shmdup(v->shm);
+    } else if(uvmcopyrange(p->pagetable, np->pagetable, v->start, v->end) < 0)
+      return -1;
+    np->vma[i] = *v;
+  }
+  return 0;
+}
+
+// Unmap all mappings of p from pagetable, and free the memory.
+// Called before the page table itself is freed.
+void
+mmapfree(struct proc *p, pagetable_t pagetable)
+{
+  for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == 0)
+      continue;
+    uvmunmap(pagetable, v->start, (v->end - v->start) / PGSIZE, 1);
+    if(v->shm)
+      shmdrop(v->shm);
+    v->start = v->end = 0;
+    v->shm = 0;
+  }
+}
+
+// Find the mapping of p that holds va, or 0.
+struct vma*
+mmaplookup(struct proc *p, uint64 va)
+{
+  for(struct vma *v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start && v->start <= va && va < v->end)
+      return v;
+  return 0;
+}
+
+// Drop the physical pages behind [addr, addr+len) of the
+// current process, for MADV_DONTNEED. The range must lie in
+// the heap or in mappings, and addr must be page-aligned.
+// Returns 0 on success, -1 on error.
+int
+madvise(uint64 addr, uint64 len, int advice)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint64 a, end;
+
+  if(advice != MADV_DONTNEED || addr % PGSIZE != 0)
+    return -1;
+  end = PGROUNDUP(addr + len);
+  if(end < addr || end > MMAPTOP)
+    return -1;
+
+  // shared pages cannot be dropped for one process alone.
+  for(a = addr; a < end; a += PGSIZE)
+    if(a >= p->sz && ((v = mmaplookup(p, a)) == 0 || v->shm))
+      return -1;
+
+  uvmdiscard(p->pagetable, addr, (end - addr) / PGSIZE);
+  return 0;
+}
+
+// Handle a page fault at va in p. If va lies in the heap or in
+// a mapping but its page is not present, map a zero-filled page,
+// or for a program segment, the page read from the executable.
+// A copy-on-write page is copied.
+// Returns 0 on success, -1 if va is not valid or out of memory.
+int
+pagefault(struct proc *p, uint64 va)
+{
+  struct vma *v;
+  struct seg *s;
+  pte_t *pte;
+  char *mem;
+  int perm;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((s = seglookup(p, va)) != 0)
+    perm = s->perm;
+  else if(va < p->sz)
+    perm = PTE_W;
+  else if((v = mmaplookup(p, va)) != 0 && v->shm == 0)
+    perm = v->perm;
+  else
+    return -1;
+
+  // a present page is copy-on-write, or a real fault
+  // (e.g. the stack guard).
+  if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V))
+    return uvmcow(p->pagetable, va);
+
+  if(s)
+    mem = loadpage(p, s, va);
+  else
+    mem = kalloc_zeroed();
+  if(mem == 0)
+    return -1;
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, PTE_R|PTE_U|perm) != 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Read in the pages of [va, va+len) of the current process
+// that come from the executable and are not present yet,
+// before copyin or copyout under a lock, where loadpage()
+// cannot sleep. Other pages fault in without sleeping.
+// Called with no lock held.
+void
+prefault(uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  uint64 a, end;
+
+  if(va + len < va)
+    len = -va;
+  for(struct seg *s = p->seg; s < &p->seg[NSEG]; s++){
+    if(s->end == 0)
+      continue;
+    a = PGROUNDDOWN(va) > s->va ? PGROUNDDOWN(va) : s->va;
+    end = va + len < s->va + s->filesz ? va + len : s->va + s->filesz;
+    for(; a < end; a += PGSIZE)
+      if(walkaddr(p->pagetable, a) == 0 && pagefault(p, a) != 0)
+        return;
+  }
+}
@@ -158,8 +158,10 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
+  if(p->pagetable){
+    mmapfree(p, p->pagetable);
     proc_freepagetable(p->pagetable, p->sz);
+  }
   p->pagetable = 0;
   p->sz = 0;
   p->pid = 0;
@@ -255,6 +257,8 @@ userinit(void)
 }
 
 // Grow or shrink user memory by n bytes.
+// Growth only reserves the range; pagefault() maps
+// zeroed pages there when they are first touched.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
@@ -264,9 +268,9 @@ growproc(int n)
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    if(sz + n > mmapfloor(p))
       return -1;
-    }
+    sz += n;
   } else if(n < 0){
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
@@ -296,6 +300,13 @@ fork(void)
   }
   np->sz = p->sz;
 
+  // Copy anonymous mappings.
+  if(mmapcopy(p, np) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
 
@@ -307,6 +318,8 @@ fork(void)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  np->exe = p->exe ? idup(p->exe) : 0;
+  memmove(np->seg, p->seg, sizeof(p->seg));
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
@@ -362,8 +375,11 @@ exit(int status)
 
   begin_op();
   iput(p->cwd);
+  if(p->exe)
+    iput(p->exe);
   end_op();
   p->cwd = 0;
+  p->exe = 0;
 
   acquire(&wait_lock);
 
@@ -394,6 +410,8 @@ wait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
+  if(addr != 0)
+    prefault(addr, sizeof(int));
   acquire(&wait_lock);
 
   for(;;){
@@ -446,12 +464,14 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int found;
   
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
+    found = 0;
     for(p = proc; p < &proc[NPROC]; p++) {
       acquire(&p->lock);
       if(p->state == RUNNABLE) {
@@ -465,9 +485,14 @@ scheduler(void)
         // Process is done running for now.
         // It should have changed its p->state before coming back.
         c->proc = 0;
+        found = 1;
       }
       release(&p->lock);
     }
+
+    // Nothing to run: zero some pages for kalloc_zeroed.
+    if(!found)
+      kzerofill();
   }
 }
 
@@ -680,4 +705,6 @@ procdump(void)
     printf("%d %s %s", p->pid, state, p->name);
     printf("\n");
   }
+  kallocdump();
+  slabdump();
 }
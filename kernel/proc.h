@@ -79,6 +79,25 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// An anonymous mapping of user memory above the heap,
+// or an attached shared memory segment.
+struct vma {
+  uint64 start;                // First address, page-aligned. 0 if unused
+  uint64 end;                  // Last address + 1, page-aligned
+  int perm;                    // PTE_R, PTE_W, PTE_X of the pages
+  struct shm *shm;             // Segment attached here, or 0
+};
+
+// A program segment that exec left to be read from the
+// executable a page at a time, as it is touched.
+struct seg {
+  uint64 va;                   // First address, page-aligned
+  uint64 end;                  // Last address + 1 (va + memsz)
+  uint off;                    // Offset in the executable
+  uint filesz;                 // Bytes from the file; the rest is zero
+  int perm;                    // PTE_W, PTE_X of the pages
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -99,6 +118,10 @@ struct proc {
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
+  struct vma vma[NVMA];        // Anonymous mappings (mmap)
+  struct inode *exe;           // Executable the segments come from
+  struct seg seg[NSEG];        // Program segments, va 0 if unused
+  int nsleeplock;              // Sleep-locks held, for loadpage()
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
@@ -0,0 +1,285 @@
+// Shared memory segments.
+//
+// A segment is a set of zeroed physical pages that any process
+// can attach into its address space with shmat, as a mapping
+// next to those of mmap. Every attach holds a reference
+// (see kref) to each page, and so does the segment, so that
+// pages stay alive as long as someone maps them, even if the
+// segment shrinks or goes away. Attaches survive fork and are
+// detached by exit and exec.
+//
+// There are no users in xv6, so the mode only limits how a
+// segment may be attached, and any process may change it.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "shm.h"
+#include "defs.h"
+
+#define NSHM     16 // segments in the system
+#define SHMMAXPG ((int)(PGSIZE / sizeof(uint64))) // pages in a segment
+
+struct shm {
+  int key;
+  int mode;       // SHM_R, SHM_W
+  int npages;
+  uint64 *pages;  // physical pages, listed in a page; 0 if unused
+  int nattach;    // vmas this segment is attached to
+  int removed;    // IPC_RMID: free after the last shmdt
+};
+
+struct {
+  struct spinlock lock;
+  struct shm seg[NSHM];
+} shmtab;
+
+void
+shminit(void)
+{
+  initlock(&shmtab.lock, "shm");
+}
+
+// Give s npages pages, allocating or freeing pages at its end.
+// Returns 0 on success, -1 if out of memory, in which case
+// s is unchanged. Called with shmtab.lock held.
+static int
+shmresize(struct shm *s, int npages)
+{
+  int i;
+
+  for(i = s->npages; i < npages; i++){
+    if((s->pages[i] = (uint64)kalloc_zeroed()) == 0){
+      while(--i >= s->npages)
+        kfree((void*)s->pages[i]);
+      return -1;
+    }
+  }
+  for(i = npages; i < s->npages; i++)
+    kfree((void*)s->pages[i]);
+  s->npages = npages;
+  return 0;
+}
+
+// Free s and its pages. Called with shmtab.lock held.
+static void
+shmdestroy(struct shm *s)
+{
+  shmresize(s, 0);
+  kfree((void*)s->pages);
+  s->pages = 0;
+}
+
+// Look up the segment with id, or 0.
+// Called with shmtab.lock held.
+static struct shm*
+shmlookup(int id)
+{
+  if(id < 0 || id >= NSHM || shmtab.seg[id].pages == 0)
+    return 0;
+  return &shmtab.seg[id];
+}
+
+// Return the id of the segment with key, creating a segment
+// of size bytes if there is none and flags has IPC_CREAT.
+// IPC_PRIVATE always creates a new segment.
+// Returns -1 on error.
+int
+shmget(int key, uint64 size, int flags)
+{
+  struct shm *s, *slot = 0;
+  int npages;
+
+  if(size > (uint64)SHMMAXPG * PGSIZE)
+    return -1;
+  npages = PGROUNDUP(size) / PGSIZE;
+
+  acquire(&shmtab.lock);
+  for(s = shmtab.seg; s < &shmtab.seg[NSHM]; s++){
+    if(s->pages == 0){
+      if(slot == 0)
+        slot = s;
+    } else if(key != IPC_PRIVATE && s->key == key && !s->removed){
+      if((flags & (IPC_CREAT|IPC_EXCL)) == (IPC_CREAT|IPC_EXCL) || npages > s->npages){
+        release(&shmtab.lock);
+        return -1;
+      }
+      release(&shmtab.lock);
+      return s - shmtab.seg;
+    }
+  }
+
+  if((flags & IPC_CREAT) == 0 || npages == 0 || (s = slot) == 0)
+    goto bad;
+  if((s->pages = (uint64*)kalloc()) == 0)
+    goto bad;
+  s->npages = 0;
+  if(shmresize(s, npages) < 0){
+    kfree((void*)s->pages);
+    s->pages = 0;
+    goto bad;
+  }
+  s->key = key;
+  s->mode = flags & (SHM_R|SHM_W);
+  s->nattach = 0;
+  s->removed = 0;
+  release(&shmtab.lock);
+  return s - shmtab.seg;
+
+ bad:
+  release(&shmtab.lock);
+  return -1;
+}
+
+// Attach segment id to the current process, at addr if it is
+// free, otherwise where mmap would put it. With SHM_RDONLY,
+// the pages are mapped read-only.
+// Returns the address, or -1 on error.
+uint64
+shmat(int id, uint64 addr, int flags)
+{
+  struct proc *p = myproc();
+  struct vma *v, *slot = 0;
+  struct shm *s;
+  uint64 len;
+  int perm, i;
+
+  if(addr % PGSIZE != 0)
+    return -1;
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start == 0){
+      slot = v;
+      break;
+    }
+  }
+  if(slot == 0)
+    return -1;
+
+  acquire(&shmtab.lock);
+  if((s = shmlookup(id)) == 0 || s->removed)
+    goto bad;
+  perm = (flags & SHM_RDONLY) ? 0 : PTE_W;
+  if((s->mode & SHM_R) == 0 || (perm && (s->mode & SHM_W) == 0))
+    goto bad;
+  len = (uint64)s->npages * PGSIZE;
+  if((addr = mmapfind(p, addr, len)) == 0)
+    goto bad;
+
+  for(i = 0; i < s->npages; i++){
+    if(mappages(p->pagetable, addr + i*PGSIZE, PGSIZE, s->pages[i], PTE_R|PTE_U|perm) != 0){
+      uvmunmap(p->pagetable, addr, i, 1);
+      goto bad;
+    }
+    kref(s->pages[i]);
+  }
+  s->nattach++;
+  release(&shmtab.lock);
+
+  slot->start = addr;
+  slot->end = addr + len;
+  slot->perm = PTE_R | perm;
+  slot->shm = s;
+  return addr;
+
+ bad:
+  release(&shmtab.lock);
+  return -1;
+}
+
+// Add an attach of s, for a vma copied by fork.
+void
+shmdup(struct shm *s)
+{
+  acquire(&shmtab.lock);
+  s->nattach++;
+  release(&shmtab.lock);
+}
+
+// Drop an attach of s, whose pages the caller has unmapped.
+// The last one frees a removed segment.
+void
+shmdrop(struct shm *s)
+{
+  acquire(&shmtab.lock);
+  if(--s->nattach == 0 && s->removed)
+    shmdestroy(s);
+  release(&shmtab.lock);
+}
+
+// Detach the segment attached at addr from the current process.
+// Returns 0 on success, -1 on error.
+int
+shmdt(uint64 addr)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->shm && v->start == addr)
+      break;
+  if(v == &p->vma[NVMA])
+    return -1;
+
+  uvmunmap(p->pagetable, v->start, (v->end - v->start) / PGSIZE, 1);
+  shmdrop(v->shm);
+  v->start = v->end = 0;
+  v->shm = 0;
+  return 0;
+}
+
+// Query or change segment id; see shm.h for the commands.
+// buf is a user address of a struct shmid_ds.
+// A resize applies to later attaches; current ones keep
+// the pages they have.
+// Returns 0 on success, -1 on error.
+int
+shmctl(int id, int cmd, uint64 buf)
+{
+  struct proc *p = myproc();
+  struct shmid_ds ds;
+  struct shm *s;
+  uint64 npages;
+
+  if((cmd == IPC_SET || cmd == SHM_RESIZE) &&
+     copyin(p->pagetable, (char*)&ds, buf, sizeof(ds)) < 0)
+    return -1;
+
+  acquire(&shmtab.lock);
+  if((s = shmlookup(id)) == 0)
+    goto bad;
+  switch(cmd){
+  case IPC_RMID:
+    s->removed = 1;
+    if(s->nattach == 0)
+      shmdestroy(s);
+    break;
+  case IPC_SET:
+    s->mode = ds.mode & (SHM_R|SHM_W);
+    break;
+  case IPC_STAT:
+    ds.key = s->key;
+    ds.mode = s->mode;
+    ds.size = (uint64)s->npages * PGSIZE;
+    ds.nattach = s->nattach;
+    break;
+  case SHM_RESIZE:
+    npages = PGROUNDUP(ds.size) / PGSIZE;
+    if(ds.size > (uint64)SHMMAXPG * PGSIZE || npages == 0 || shmresize(s, npages) < 0)
+      goto bad;
+    break;
+  default:
+    goto bad;
+  }
+  release(&shmtab.lock);
+
+  if(cmd == IPC_STAT && copyout(p->pagetable, buf, (char*)&ds, sizeof(ds)) < 0)
+    return -1;
+  return 0;
+
+ bad:
+  release(&shmtab.lock);
+  return -1;
+}
@@ -0,0 +1,22 @@
+// shmget flags; the low bits are the segment's mode.
+#define IPC_PRIVATE 0       // key for a segment no one else can find
+#define IPC_CREAT   01000   // create the segment if the key is new
+#define IPC_EXCL    02000   // with IPC_CREAT, fail if it is not
+#define SHM_R       0400    // segment may be attached
+#define SHM_W       0200    // segment may be attached writable
+
+// shmat flags
+#define SHM_RDONLY  010000  // attach read-only
+
+// shmctl commands
+#define IPC_RMID    0       // free the segment after the last shmdt
+#define IPC_SET     1       // set the mode from shmid_ds
+#define IPC_STAT    2       // fill in shmid_ds
+#define SHM_RESIZE  3       // set the size from shmid_ds
+
+struct shmid_ds {
+  int key;     // Key given to shmget
+  int mode;    // SHM_R, SHM_W
+  uint64 size; // Size of segment in bytes
+  int nattach; // Number of current attaches
+};
@@ -0,0 +1,235 @@
+// Slab allocator, for kernel objects smaller than a page.
+//
+// A cache hands out objects of one size. It carves pages from
+// kalloc into slabs: a struct slab at the start of the page,
+// then as many objects as fit. Slabs with free objects sit on
+// the cache's partial list; a slab whose objects are all free
+// goes back to kalloc, except for one kept for the next alloc.
+//
+// Each CPU keeps a magazine of free objects per cache, so that
+// most kmem_cache_alloc and kmem_cache_free calls touch only
+// that CPU's magazine, with interrupts off, and no lock. The
+// magazines refill from and flush to the slabs MAGBATCH
+// objects at a time.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+
+#define NCACHE   8  // slab caches in the system
+#define MAGSIZE  16 // objects in a full magazine
+#define MAGBATCH 8  // objects moved to or from the slabs at a time
+
+struct obj {
+  struct obj *next;
+};
+
+// At the start of each slab page.
+struct slab {
+  struct kmem_cache *cache; // the cache this slab belongs to
+  struct slab *next;  // on the partial list
+  struct obj *free;   // free objects in this slab
+  int inuse;          // objects handed out, or in magazines
+};
+
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct kmem_cache {
+  struct spinlock lock;
+  char *name;
+  uint size;            // bytes per object, rounded up
+  int nobj;             // objects per slab
+  struct slab *partial; // slabs with free objects
+  struct slab *empty;   // a slab kept with no objects in use
+  int nslab;            // slab pages held
+  struct magazine mag[NCPU];
+};
+
+struct {
+  struct spinlock lock;
+  struct kmem_cache cache[NCACHE];
+  int n;
+} slabs;
+
+void
+slabinit(void)
+{
+  initlock(&slabs.lock, "slabs");
+}
+
+// Create a cache of objects of size bytes, named for
+// debugging. Caches are never destroyed.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size)
+{
+  struct kmem_cache *c;
+
+  size = (size + 7) & ~7;
+  if(size < sizeof(struct obj) || size > PGSIZE - sizeof(struct slab))
+    panic("kmem_cache_create: size");
+
+  acquire(&slabs.lock);
+  if(slabs.n == NCACHE)
+    panic("kmem_cache_create: too many");
+  c = &slabs.cache[slabs.n++];
+  release(&slabs.lock);
+
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->nobj = (PGSIZE - sizeof(struct slab)) / size;
+  return c;
+}
+
+// Make a slab page for c and carve it into objects.
+// Returns 0 if out of memory. Called with c->lock held.
+static struct slab*
+slabgrow(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *p;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->cache = c;
+  s->next = 0;
+  s->free = 0;
+  s->inuse = 0;
+  p = (char*)s + sizeof(struct slab);
+  for(int i = c->nobj - 1; i >= 0; i--){
+    struct obj *o = (struct obj*)(p + i*c->size);
+    o->next = s->free;
+    s->free = o;
+  }
+  c->nslab++;
+  return s;
+}
+
+// Move up to MAGBATCH objects from the slabs of c into m.
+// Called with c->lock held.
+static void
+magrefill(struct kmem_cache *c, struct magazine *m)
+{
+  struct slab *s;
+  struct obj *o;
+
+  while(m->n < MAGBATCH){
+    if((s = c->partial) == 0){
+      if((s = c->empty) != 0)
+        c->empty = 0;
+      else if((s = slabgrow(c)) == 0)
+        return;
+      s->next = c->partial;
+      c->partial = s;
+    }
+    o = s->free;
+    s->free = o->next;
+    s->inuse++;
+    m->obj[m->n++] = o;
+    if(s->free == 0)
+      c->partial = s->next; // full slabs are on no list
+  }
+}
+
+// Return the object o to its slab in c.
+// Called with c->lock held.
+static void
+slabput(struct kmem_cache *c, void *o)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)o);
+  struct slab **pp;
+
+  if(s->free == 0){
+    s->next = c->partial;
+    c->partial = s;
+  }
+  ((struct obj*)o)->next = s->free;
+  s->free = o;
+  if(--s->inuse > 0)
+    return;
+
+  // all free: take s off the partial list, and keep it
+  // or give it back.
+  for(pp = &c->partial; *pp != s; pp = &(*pp)->next)
+    ;
+  *pp = s->next;
+  if(c->empty == 0){
+    c->empty = s;
+  } else {
+    c->nslab--;
+    kfree((void*)s);
+  }
+}
+
+// Allocate an object from c.
+// Returns 0 if the memory cannot be allocated.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct magazine *m;
+  void *o = 0;
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    acquire(&c->lock);
+    magrefill(c, m);
+    release(&c->lock);
+  }
+  if(m->n > 0)
+    o = m->obj[--m->n];
+  pop_off();
+  return o;
+}
+
+// Free an object allocated from c.
+void
+kmem_cache_free(struct kmem_cache *c, void *o)
+{
+  struct magazine *m;
+  struct slab *s;
+  uint64 off;
+
+  if((uint64)o % 8 != 0 || (uint64)o < KERNBASE || (uint64)o >= PHYSTOP)
+    panic("kmem_cache_free");
+
+  // o must be an object in a slab of c: an object of another
+  // cache, or a pointer into the middle of one, would be
+  // handed out later as a whole object of c.
+  // s->cache is set before the slab's objects are handed out,
+  // and does not change while any of them is in use.
+  s = (struct slab*)PGROUNDDOWN((uint64)o);
+  off = (uint64)o - ((uint64)s + sizeof(struct slab));
+  if(s->cache != c || (uint64)o < (uint64)s + sizeof(struct slab) ||
+     off % c->size != 0 || off / c->size >= c->nobj)
+    panic("kmem_cache_free: not from this cache");
+
+  push_off();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    while(m->n > MAGSIZE - MAGBATCH)
+      slabput(c, m->obj[--m->n]);
+    release(&c->lock);
+  }
+  m->obj[m->n++] = o;
+  pop_off();
+}
+
+// Print the slabs held by each cache.
+// Runs from procdump; no lock, like procdump.
+void
+slabdump(void)
+{
+  for(int i = 0; i < slabs.n; i++){
+    struct kmem_cache *c = &slabs.cache[i];
+    printf("slab %s: %d bytes, %d per page, %d pages\n",
+           c->name, c->size, c->nobj, c->nslab);
+  }
+}
@@ -18,6 +18,10 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->pid = 0;
 }
 
+// A sleep-lock is released by the process that acquired it;
+// releasesleep checks this. Each process counts the
+// sleep-locks it holds in p->nsleeplock, so that loadpage()
+// does not read a file while one is held.
 void
 acquiresleep(struct sleeplock *lk)
 {
@@ -27,6 +31,7 @@ acquiresleep(struct sleeplock *lk)
   }
   lk->locked = 1;
   lk->pid = myproc()->pid;
+  myproc()->nsleeplock++;
   release(&lk->lk);
 }
 
@@ -34,8 +39,11 @@ void
 releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
+  if(!lk->locked || lk->pid != myproc()->pid)
+    panic("releasesleep");
   lk->locked = 0;
   lk->pid = 0;
+  myproc()->nsleeplock--;
   wakeup(lk);
   release(&lk->lk);
 }
@@ -8,11 +8,18 @@
 #include "defs.h"
 
 // Fetch the uint64 at addr from the current process.
+// addr may be in the heap, or in a mapping, where malloc
+// puts large buffers (such as an exec argv array).
 int
 fetchaddr(uint64 addr, uint64 *ip)
 {
   struct proc *p = myproc();
-  if(addr >= p->sz || addr+sizeof(uint64) > p->sz) // both tests needed, in case of overflow
+  struct vma *v;
+
+  if(addr+sizeof(uint64) < addr) // overflow
+    return -1;
+  if(addr+sizeof(uint64) > p->sz &&
+     ((v = mmaplookup(p, addr)) == 0 || addr+sizeof(uint64) > v->end))
     return -1;
   if(copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
@@ -102,6 +109,14 @@ extern uint64 sys_link(void);
 extern uint64 sys_mkdir(void);
 extern uint64 sys_close(void);
 extern uint64 sys_getclk(void);
+extern uint64 sys_mmap(void);
+extern uint64 sys_munmap(void);
+extern uint64 sys_madvise(void);
+extern uint64 sys_mremap(void);
+extern uint64 sys_shmget(void);
+extern uint64 sys_shmat(void);
+extern uint64 sys_shmdt(void);
+extern uint64 sys_shmctl(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -128,6 +143,14 @@ static uint64 (*syscalls[])(void) = {
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
 [SYS_getclk]  sys_getclk,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_madvise] sys_madvise,
+[SYS_mremap]  sys_mremap,
+[SYS_shmget]  sys_shmget,
+[SYS_shmat]   sys_shmat,
+[SYS_shmdt]   sys_shmdt,
+[SYS_shmctl]  sys_shmctl,
 };
 
 void
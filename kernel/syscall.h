@@ -21,3 +21,11 @@
 #define SYS_mkdir  20
 #define SYS_close  21
 #define SYS_getclk 22
+#define SYS_mmap   23
+#define SYS_munmap 24
+#define SYS_madvise 25
+#define SYS_mremap 26
+#define SYS_shmget 27
+#define SYS_shmat  28
+#define SYS_shmdt  29
+#define SYS_shmctl 30
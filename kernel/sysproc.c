@@ -94,4 +94,97 @@ uint64
 sys_getclk(void)
 {
   return *(uint64*) CLINT_MTIME;
-}
\ No newline at end of file
+}
+
+uint64
+sys_mmap(void)
+{
+  uint64 addr, len;
+  int prot, flags;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  argint(2, &prot);
+  argint(3, &flags);
+  return mmap(addr, len, prot, flags);
+}
+
+uint64
+sys_munmap(void)
+{
+  uint64 addr, len;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  return munmap(addr, len);
+}
+
+uint64
+sys_madvise(void)
+{
+  uint64 addr, len;
+  int advice;
+
+  argaddr(0, &addr);
+  argaddr(1, &len);
+  argint(2, &advice);
+  return madvise(addr, len, advice);
+}
+
+uint64
+sys_mremap(void)
+{
+  uint64 addr, oldlen, newlen;
+  int flags;
+
+  argaddr(0, &addr);
+  argaddr(1, &oldlen);
+  argaddr(2, &newlen);
+  argint(3, &flags);
+  return mremap(addr, oldlen, newlen, flags);
+}
+
+uint64
+sys_shmget(void)
+{
+  uint64 size;
+  int key, flags;
+
+  argint(0, &key);
+  argaddr(1, &size);
+  argint(2, &flags);
+  return shmget(key, size, flags);
+}
+
+uint64
+sys_shmat(void)
+{
+  uint64 addr;
+  int id, flags;
+
+  argint(0, &id);
+  argaddr(1, &addr);
+  argint(2, &flags);
+  return shmat(id, addr, flags);
+}
+
+uint64
+sys_shmdt(void)
+{
+  uint64 addr;
+
+  argaddr(0, &addr);
+  return shmdt(addr);
+}
+
+uint64
+sys_shmctl(void)
+{
+  uint64 buf;
+  int id, cmd;
+
+  argint(0, &id);
+  argint(1, &cmd);
+  argaddr(2, &buf);
+  return shmctl(id, cmd, buf);
+}
@@ -65,6 +65,19 @@ usertrap(void)
     intr_on();
 
     syscall();
+  } else if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15){
+    // instruction, load or store page fault, on a page that
+    // is not present yet or is copy-on-write. reading a page
+    // of the executable sleeps, so enable interrupts, but
+    // only once scause and stval have been read.
+    uint64 scause = r_scause();
+    uint64 va = r_stval();
+    intr_on();
+    if(pagefault(p, va) != 0){
+      printf("usertrap(): unexpected scause %p pid=%d\n", scause, p->pid);
+      printf("            sepc=%p stval=%p\n", p->trapframe->epc, va);
+      setkilled(p);
+    }
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 
@@ -15,6 +17,8 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+static pte_t *walklevel(pagetable_t, uint64, int, int);
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
@@ -40,6 +44,7 @@ kvmmake(void)
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
   // map kernel data and the physical RAM we'll make use of.
+  // kvmmap uses megapages for the aligned part of it.
   kvmmap(kpgtbl, (uint64)etext, (uint64)etext, PHYSTOP-(uint64)etext, PTE_R | PTE_W);
 
   // map the trampoline for trap entry/exit to
@@ -85,24 +90,36 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// A leaf PTE may also sit in a level-1 page table, mapping a
+// 2-megabyte megapage; walk returns that PTE for any va in it.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+  return walklevel(pagetable, va, alloc, 0);
+}
+
+// Like walk, but return the PTE in the level-stop page table,
+// or an existing leaf PTE above it.
+static pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int alloc, int stop)
 {
   if(va >= MAXVA)
     panic("walk");
 
-  for(int level = 2; level > 0; level--) {
+  for(int level = 2; level > stop; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
     if(*pte & PTE_V) {
+      if(*pte & (PTE_R|PTE_W|PTE_X))
+        return pte;
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
-  return &pagetable[PX(0, va)];
+  return &pagetable[PX(stop, va)];
 }
 
 // Look up a virtual address, return the physical address,
@@ -134,10 +151,44 @@ walkaddr(pagetable_t pagetable, uint64 va)
 void
 kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kpgtbl, va, sz, pa, perm) != 0)
+  if(mapmegapages(kpgtbl, va, sz, pa, perm) != 0)
     panic("kvmmap");
 }
 
+// Like mappages, but use a 2-megabyte megapage wherever va and
+// pa are both aligned to one and the range covers all of it,
+// so that a single TLB entry maps it. Only for page tables
+// that are never unmapped a page at a time, i.e. the kernel's.
+int
+mapmegapages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
+{
+  uint64 a, end;
+  pte_t *pte;
+
+  if(size == 0)
+    panic("mapmegapages: size");
+
+  a = PGROUNDDOWN(va);
+  end = PGROUNDUP(va + size);
+  while(a < end){
+    if(a % MEGAPGSIZE == 0 && pa % MEGAPGSIZE == 0 && end - a >= MEGAPGSIZE){
+      if((pte = walklevel(pagetable, a, 1, 1)) == 0)
+        return -1;
+      if(*pte & PTE_V)
+        panic("mapmegapages: remap");
+      *pte = PA2PTE(pa) | perm | PTE_V;
+      a += MEGAPGSIZE;
+      pa += MEGAPGSIZE;
+    } else {
+      if(mappages(pagetable, a, PGSIZE, pa, perm) != 0)
+        return -1;
+      a += PGSIZE;
+      pa += PGSIZE;
+    }
+  }
+  return 0;
+}
+
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned. Returns 0 on success, -1 if walk() couldn't
@@ -168,7 +219,8 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Pages that are not present (e.g. dropped by
+// uvmdiscard) are skipped.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
@@ -181,9 +233,9 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
     if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
+      continue;
     if((*pte & PTE_V) == 0)
-      panic("uvmunmap: not mapped");
+      continue;
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
     if(do_free){
@@ -200,10 +252,9 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -217,8 +268,7 @@ uvmfirst(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("uvmfirst: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
@@ -236,12 +286,11 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -289,6 +338,29 @@ freewalk(pagetable_t pagetable)
   kfree((void*)pagetable);
 }
 
+// Map the pages of old from start to end into new as they
+// are, e.g. an attached shared memory segment. Each page
+// gains a reference. start must be page-aligned.
+// returns 0 on success, -1 on failure.
+// frees any allocated pages on failure.
+int
+uvmshare(pagetable_t old, pagetable_t new, uint64 start, uint64 end)
+{
+  pte_t *pte;
+  uint64 i;
+
+  for(i = start; i < end; i += PGSIZE){
+    if((pte = walk(old, i, 0)) == 0 || (*pte & PTE_V) == 0)
+      panic("uvmshare: page not present");
+    if(mappages(new, i, PGSIZE, PTE2PA(*pte), PTE_FLAGS(*pte)) != 0){
+      uvmunmap(new, start, (i - start) / PGSIZE, 1);
+      return -1;
+    }
+    kref(PTE2PA(*pte));
+  }
+  return 0;
+}
+
 // Free user memory pages,
 // then free page-table pages.
 void
@@ -301,37 +373,42 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// The pages themselves are shared copy-on-write.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
+{
+  return uvmcopyrange(old, new, 0, sz);
+}
+
+// Like uvmcopy, but for the pages from start to end,
+// e.g. an mmap region. start must be page-aligned.
+// Writable pages become read-only and PTE_COW in both
+// page tables; uvmcow() copies them on the first store.
+int
+uvmcopyrange(pagetable_t old, pagetable_t new, uint64 start, uint64 end)
 {
   pte_t *pte;
   uint64 pa, i;
   uint flags;
-  char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
+  for(i = start; i < end; i += PGSIZE){
+    // a discarded page stays discarded in the child.
+    if((pte = walk(old, i, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    }
+    kref(pa);
   }
   return 0;
 
  err:
-  uvmunmap(new, 0, i / PGSIZE, 1);
+  uvmunmap(new, start, (i - start) / PGSIZE, 1);
   return -1;
 }
 
@@ -348,19 +425,121 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// Drop the physical pages behind npages of user memory
+// starting at va, and leave the range valid: the next touch
+// faults in a zero-filled page (see pagefault()).
+// Only writable (or copy-on-write) user pages are dropped.
+void
+uvmdiscard(pagetable_t pagetable, uint64 va, uint64 npages)
+{
+  uint64 a;
+  pte_t *pte;
+
+  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
+    if((pte = walk(pagetable, a, 0)) == 0)
+      continue;
+    if((*pte & (PTE_V|PTE_U)) != (PTE_V|PTE_U) || (*pte & (PTE_W|PTE_COW)) == 0)
+      continue;
+    kfree((void*)PTE2PA(*pte));
+    *pte = 0;
+  }
+}
+
+// Move npages of user mappings from va to newva without copying
+// the memory behind them. The ranges must not overlap, and newva
+// must not be mapped. Returns 0 on success, -1 if a page-table
+// page could not be allocated, in which case nothing has moved.
+int
+uvmmove(pagetable_t pagetable, uint64 va, uint64 newva, uint64 npages)
+{
+  uint64 i;
+  pte_t *pte;
+
+  // allocate all page-table pages first, so that
+  // mappages below cannot fail half way.
+  for(i = 0; i < npages; i++)
+    if(walk(pagetable, newva + i*PGSIZE, 1) == 0)
+      return -1;
+
+  for(i = 0; i < npages; i++){
+    if((pte = walk(pagetable, va + i*PGSIZE, 0)) == 0 || (*pte & PTE_V) == 0)
+      continue;
+    if(mappages(pagetable, newva + i*PGSIZE, PGSIZE, PTE2PA(*pte), PTE_FLAGS(*pte)) != 0)
+      panic("uvmmove");
+  }
+  uvmunmap(pagetable, va, npages, 0);
+  return 0;
+}
+
+// Give va its own writable copy of a copy-on-write page.
+// The last process to hold the page keeps it as it is.
+// Returns 0 on success, -1 if va is not copy-on-write
+// or out of memory.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA || (pte = walk(pagetable, va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_V|PTE_U|PTE_COW)) != (PTE_V|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W;
+
+  if(krefcount(pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+    return 0;
+  }
+  if((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, (char*)pa, PGSIZE);
+  *pte = PA2PTE(mem) | flags;
+  kfree((void*)pa);
+  return 0;
+}
+
+// Look up a user virtual address like walkaddr, but first
+// fault in a page of the current process that is not present.
+// Used by copyin and copyout.
+static uint64
+walkaddrfault(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+
+  pa = walkaddr(pagetable, va);
+  if(pa == 0 && p != 0 && p->pagetable == pagetable && pagefault(p, va) == 0)
+    pa = walkaddr(pagetable, va);
+  return pa;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
+// Fails on pages the user could not write either, such as
+// shared text or a read-only shm attach.
 // Return 0 on success, -1 on error.
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
 
+  pte_t *pte;
+
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = walkaddrfault(pagetable, va0);
     if(pa0 == 0)
       return -1;
+    pte = walk(pagetable, va0, 0);
+    if((*pte & PTE_W) == 0){
+      if((*pte & PTE_COW) == 0 || uvmcow(pagetable, va0) != 0)
+        return -1;
+      pa0 = PTE2PA(*pte);
+    }
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
@@ -383,7 +562,7 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = walkaddrfault(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -410,7 +589,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = walkaddrfault(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -21,6 +21,7 @@ pack_allocate(struct pack *__restrict pack) {
 
     pack_set_prev(next, size); // I'm not sure if this is necessary.
     pack_add_meta(next, PREV_INUSE);
+    fresh_mark((size_t)next);
 
     return pack->data;
 }
@@ -50,6 +51,7 @@ split_allocate(struct pack *__restrict pack, size_t need) {
 
     /* temp is the newly generated chunk. */
     struct pack *temp = pack_next(pack);
+    fresh_mark((size_t)temp);
     pack_set_prev(temp, need);
     pack_set_info(temp, rest, PREV_INUSE);
 
@@ -78,62 +80,89 @@ try_split_allocate(struct pack *__restrict pack, size_t need) {
 /* Safely remove the first node from the list. */
 static inline struct node *
 list_extract(size_t index) {
-    struct node *list = &slots[index];
+    struct node *list = &heap->slots[index];
     struct node *node = list_pop(list);
     if (list_empty(list)) bitmap_clr(index);
     return node;
 }
 
 /**
- * @brief Allocate memory from a larger-indexed slot.
+ * @brief Take a chunk out of a larger-indexed slot.
  * @param index Index of current size's slot.
- * @param size Allocated size.
- * @return Data pointer. Never return NULL.
+ * @param size Required size.
+ * @return Pack of the chunk, out of any list.
+ * nullptr if out of memory.
  */
-static inline void *
-next_allocate(size_t index, size_t size) {
+static inline struct pack *
+next_chunk(size_t index, size_t size) {
     uint64_t lowbit = next_free(index);
-    if (lowbit == 0) return malloc_brk(size);
+    if (lowbit == 0) return extend_brk(size);
 
-    size_t position = log2_ceil64(lowbit);
+    size_t position = ctz64(lowbit);
 
     struct node *node = list_extract(position);
-    struct pack *pack = list_pack(node);
+    return list_pack(node);
+}
 
+/**
+ * @brief Allocate memory from a larger-indexed slot.
+ * @param index Index of current size's slot.
+ * @param size Allocated size.
+ * @return Data pointer. Never return NULL.
+ */
+static inline void *
+next_allocate(size_t index, size_t size) {
+    struct pack *pack = next_chunk(index, size);
+    if (pack == (struct pack *)0) return 0;
     return try_split_allocate(pack, size);
 }
 
 /**
- * @brief Allocate memory from the fast slot for
- * extremely small memory, with fixed size = 32 bytes.
- * @return Data pointer. nullptr if failed.
+ * @brief Split the pack into count chunks of the same size.
+ * @param pack Pointer to the pack.
+ * @param need Size of each chunk.
+ * @param count Count of chunks. Positive.
+ * @param out Data pointers of the chunks.
+ * @attention Same as try_split_allocate. In addition,
+ * the pack should be no smaller than count * need.
  */
-static inline void *
-fast_allocate(void) {
-    struct node *list = slots + 1;
-    if (list_empty(list)) return (void *)0;
-    struct node *node = list->next;
-    struct pack *pack = list_pack(node);
+static inline void
+carve_allocate(struct pack *__restrict pack, size_t need,
+               size_t count, void **out) {
+    IMPOSSIBLE(pack_size(pack) < need * count);
+    size_t rest = pack_size(pack);
+    while (--count != 0) {
+        rest -= need;
+        pack_set_info(pack, need, BOTH_INUSE);
+        *out++ = pack->data;
+
+        struct pack *next = pack_next(pack);
+        pack_set_prev(next, need);
+        pack_set_info(next, rest, PREV_INUSE);
+        pack = next;
+    }
+    *out = try_split_allocate(pack, need);
+}
 
-    size_t *map = (size_t *)(pack->data + sizeof(struct node));
+/**
+ * @brief Take a free chunk out of a fast page.
+ * @param map Bitmap header of the page.
+ * @return Data pointer. Never return NULL.
+ * @attention The page should have a free chunk.
+ */
+static inline void *
+fast_take(size_t *map) {
     size_t  mem = (size_t)(map + 3);    // Memory start address.
-    IMPOSSIBLE(map[0] == 0);
-
-    if (--map[0] == 0)
-        list_push(&fast_full, list_pop(list));
-
-    size_t index = 0;
+    size_t  index = 0;
     if (map[1] != 0) {
         size_t high = log2_floor64(map[1]);
         map[1] &= ~(1ull << high);
         index = high;
-    } else if (map[2] != 0) {
+    } else {
+        IMPOSSIBLE(map[2] == 0);
         size_t high = log2_floor64(map[2]);
         map[2] &= ~(1ull << high);
         index = high + 64;
-    } else {
-        IMPOSSIBLE(1);
-        return (void *)0;
     }
 
     // The flag of next of size = 32 is meaningless.
@@ -143,6 +172,27 @@ fast_allocate(void) {
     return next->data;
 }
 
+/**
+ * @brief Allocate memory from the fast slot for
+ * extremely small memory, with fixed size = 32 bytes.
+ * @return Data pointer. nullptr if failed.
+ */
+static inline void *
+fast_allocate(void) {
+    struct node *list = heap->slots + 1;
+    if (list_empty(list)) return (void *)0;
+    struct node *node = list->next;
+    struct pack *pack = list_pack(node);
+
+    size_t *map = (size_t *)(pack->data + sizeof(struct node));
+    IMPOSSIBLE(map[0] == 0);
+
+    if (--map[0] == 0)
+        list_push(&heap->fast_full, list_pop(list));
+
+    return fast_take(map);
+}
+
 /**
  * @brief Allocate memory from a tiny slot.
  * Each node is fixed, aligned to 16 bytes, and the
@@ -153,12 +203,43 @@ fast_allocate(void) {
  */
 static inline void *
 tiny_allocate(size_t index) {
-    if (list_empty(slots + index)) return (void *)0;
+    if (list_empty(heap->slots + index)) return (void *)0;
     struct node *node = list_extract(index);
     struct pack *pack = list_pack(node);
     return pack_allocate(pack);
 }
 
+/**
+ * @brief Find a chunk of at least need bytes in a slot.
+ * The first fits look at no more than iteration nodes;
+ * PLACE_BEST looks at the whole slot for the smallest.
+ * @return Node of the chunk, still in the slot.
+ * nullptr if not found.
+ */
+static inline struct node *
+slot_fit(size_t index, size_t need, size_t iteration) {
+    struct node *list = heap->slots + index;
+    struct node *head = list->next;
+#if PLACEMENT == PLACE_BEST
+    struct node *best = 0;
+    size_t least = (size_t)-1;
+    (void)iteration;
+    for (; head != list; head = head->next) {
+        size_t size = pack_size(list_pack(head));
+        if (size >= need && size < least) {
+            best = head;
+            least = size;
+            if (size == need) break;
+        }
+    }
+    return best;
+#else
+    for (; iteration-- != 0 && head != list; head = head->next)
+        if (pack_size(list_pack(head)) >= need) return head;
+    return 0;
+#endif
+}
+
 /**
  * @brief Allocate memory from corresponding slot.
  * Each node is dynamic-sized.
@@ -179,21 +260,11 @@ tiny_allocate(size_t index) {
  */
 static inline void *
 iterative_allocate(size_t index, size_t need, size_t iteration) {
-    struct node *list = slots + index;
-    struct node *head = list->next;
-    while (iteration-- != 0 && head != list) {
-        struct pack *pack = list_pack(head);
-        size_t size = pack_size(pack);
-
-        if (size >= need) {
-            safe_remove(head, index);
-            return pack_allocate(pack);
-        }
-
-        head = head->next;
-    }
+    struct node *node = slot_fit(index, need, iteration);
+    if (node == (struct node *)0) return (void *)0;
 
-    return (void *)0;
+    safe_remove(node, index);
+    return pack_allocate(list_pack(node));
 }
 
 static void *malloc_huge(size_t);
@@ -203,12 +274,13 @@ static void *malloc_huge(size_t);
  * @return 
  */
 static inline void fast_bin_reserve(void) {
-    if (!list_empty(slots + 1)) return;
+    if (!list_empty(heap->slots + 1)) return;
 
     void *data = malloc_huge(4096 + 48);
+    if (data == (void *)0) return;  // Out of memory.
     struct node *node = (struct node *)data;
 
-    list_push(slots + 1, node);
+    list_push(heap->slots + 1, node);
 
     struct pack *pack = list_pack(node);
     
@@ -220,26 +292,23 @@ static inline void fast_bin_reserve(void) {
 
 /* Initialize all the lists. */
 static inline void mm_list_init(void) {
-    for (size_t i = 0; i < 64; i++) list_init(&slots[i]);
-    list_init(&fast_full);
+    for (size_t i = 0; i < 64; i++) list_init(&heap->slots[i]);
+    list_init(&heap->fast_full);
+    heap->bitmap = 0;
 }
 
-/* Align the top to 4096 and align the base to 8. */
-static inline void mm_align_init(void) {
-    size_t heap = (size_t)sbrk(PAGE_SIZE);
-    size_t temp = heap % PAGE_SIZE;
-    size_t size = PAGE_SIZE;
-
-    if (temp != 0) {
-        size += PAGE_SIZE - temp;
-        sbrk(PAGE_SIZE - temp);
-    }
-
-    size_t top = heap + size;
-    size_t low = ALIGN(heap) + sizeof(struct pack);
+/**
+ * @brief Lay out a segment of the heap: an unreachable
+ * head, one chunk in between and a tail in use.
+ * @param start Start of the segment.
+ * @param top  End of the segment, aligned to 4096.
+ * @return Pack of the chunk, out of any list.
+ */
+static inline struct pack *segment_init(size_t start, size_t top) {
+    size_t low  = ALIGN(start) + sizeof(struct pack);
+    size_t size = top - low;
 
-    base = (struct node *)top;
-    size = top - low;
+    heap->base = (struct node *)top;
 
     /* Regard previous memory of first part. as unreachable. */
     struct node *head = (struct node *)(low);
@@ -254,27 +323,150 @@ static inline void mm_align_init(void) {
     pack_set_prev(next, size);
     pack_set_info(next, TAIL, THIS_INUSE);
 
-    return free_chunk(pack);
+    return pack;
 }
 
-/* Allocate memory from the brk */
-static inline void *malloc_brk(size_t need) {
-    struct pack *pack = list_pack(base);
+/* Heap growth callbacks. */
 
-    size_t page = (need + PAGE_SIZE - 1) / PAGE_SIZE;
-    size_t size = page * PAGE_SIZE;
+static char *grow_sbrk(struct heap *h, size_t size) {
+    (void)h;
+    if (size > 0x7FFFFFFF) return (char *)-1;
+    char *old = sbrk((int)size);
+    if (old == (char *)-1) return old;
+    usage.brk = (size_t)old + size;
+    usage_update();
+    return old;
+}
 
-    pack_set_size(pack, size);
+/* Hand out the rest of a fixed region. */
+static char *grow_fixed(struct heap *h, size_t size) {
+    if (size > h->end - h->brk) return (char *)-1;
+    h->brk += size;
+    return (char *)(h->brk - size);
+}
 
-    size_t heap = (size_t)(base);
-    base = (struct node *)(heap + size);
+/**
+ * @brief Hand out the rest of the last mapping, and map
+ * another step when it runs out. The new mapping keeps
+ * a step to spare, so that the next calls can follow it.
+ */
+static char *grow_mmap(struct heap *h, size_t size) {
+    if (size <= h->end - h->brk) return grow_fixed(h, size);
+
+    size_t len = (size + h->step + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    char *addr = mmap(0, len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS);
+    if (addr == (char *)-1) return addr;
+    usage_map(len);
+
+    h->brk = (size_t)addr;
+    h->end = (size_t)addr + len;
+    return grow_fixed(h, size);
+}
 
-    if (sbrk(size) == (char *)-1) return 0; // Out of memory.
+/* Align the top to 4096 and align the base to 8. */
+static inline void mm_align_init(void) {
+    char *brk = heap->grow(heap, PAGE_SIZE);
+    if (brk == (char *)-1) { heap->base = 0; return; }
+
+    size_t start = (size_t)brk;
+    size_t temp = start % PAGE_SIZE;
+    size_t size = PAGE_SIZE;
+
+    if (temp != 0) {
+        size += PAGE_SIZE - temp;
+        if (heap->grow(heap, PAGE_SIZE - temp) == (char *)-1) {
+            heap->base = 0;
+            return;
+        }
+    }
+
+    heap->fresh = start;
+    heap->ahead = PAGE_SIZE;
+    heap->total = size;
+    return free_chunk(segment_init(start, start + size));
+}
+
+/**
+ * @brief Someone else has moved the break, so the memory
+ * from sbrk does not follow the top. Start a new segment
+ * there, and leave the old tail as the end of the old one.
+ * @param start Memory from sbrk.
+ * @param size Size of the memory, aligned to 4096.
+ * @param need Required size.
+ */
+static inline struct pack *
+extend_segment(size_t start, size_t size, size_t need) {
+    size_t low = ALIGN(start) + sizeof(struct pack);
+    size_t top = start + size;
+    if (top < low + need) top = low + need;
+    top = (top + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+
+    size_t more = top - (start + size);
+    if (more != 0 && heap->grow(heap, more) != (char *)(start + size))
+        return 0; // Out of memory.
+
+    return segment_init(start, top);
+}
+
+/**
+ * @brief Size to grow the top by for a chunk of need bytes.
+ * A free chunk below the top counts towards the need. While
+ * the heap keeps growing, the growth doubles each time, up to
+ * GROW_MAX and 1/32 of the heap, so that a steady climb
+ * takes fewer calls to grow.
+ */
+static inline size_t grow_size(struct pack *tail, size_t need) {
+    size_t have = pack_meta(tail) & PREV_INUSE ? 0 : tail->prev;
+    size_t size = need > have ? need - have : 0;
+    if (size < heap->ahead) size = heap->ahead;
+    size = (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+
+    size_t ahead = heap->ahead * 2;
+    if (ahead > GROW_MAX) ahead = GROW_MAX;
+    if (ahead > heap->total / 32) ahead = heap->total / 32;
+    if (ahead > heap->ahead) heap->ahead = ahead;
+    return size;
+}
+
+/**
+ * @brief Grow the heap to hold a chunk of at least need bytes.
+ * @return Pack of the chunk merged with the previous free chunk,
+ * out of any list. nullptr if out of memory.
+ */
+static inline struct pack *extend_brk(size_t need) {
+    struct pack *pack = list_pack(heap->base);
+
+    size_t size = grow_size(pack, need);
+
+    char *brk = heap->grow(heap, size);
+    if (brk == (char *)-1) {
+        /* Try again without growing ahead. */
+        heap->ahead = PAGE_SIZE;
+        size = grow_size(pack, need);
+        if ((brk = heap->grow(heap, size)) == (char *)-1)
+            return 0; // Out of memory.
+    }
+    heap->total += size;
+    if (brk != (char *)heap->base)
+        return extend_segment((size_t)brk, size, need);
+
+    pack_set_size(pack, size);
+    pack_clr_meta(pack, THIS_INUSE);
+
+    size_t start = (size_t)(heap->base);
+    heap->base = (struct node *)(start + size);
 
     struct pack *next = pack_next(pack);
     pack_set_info(next, 0, THIS_INUSE);
 
-    return try_split_allocate(try_merge_prev(pack), need);
+    struct pack *prev = try_merge_prev(pack);
+    if (prev != pack) {
+        /* The old tail now lies in user memory. Keep it fresh. */
+        pack->prev = 0;
+        pack->size = 0;
+    }
+    return prev;
 }
 
 /** Input wrapper of different size. */
@@ -284,13 +476,40 @@ static inline void *malloc_fast(void) {
     return fast_allocate();
 }
 
+/**
+ * @brief Allocate a batch of fast chunks, draining
+ * one page at a time before touching the list.
+ * @return Count of chunks allocated.
+ */
+static inline size_t
+fast_allocate_batch(size_t count, void **out) {
+    struct node *list = heap->slots + 1;
+    size_t done = 0;
+    while (done != count) {
+        fast_bin_reserve();
+        if (list_empty(list)) break;
+
+        struct pack *pack = list_pack(list->next);
+        size_t *map = (size_t *)(pack->data + sizeof(struct node));
+        IMPOSSIBLE(map[0] == 0);
+
+        size_t take = count - done;
+        if (take > map[0]) take = map[0];
+        map[0] -= take;
+        while (take-- != 0) out[done++] = fast_take(map);
+
+        if (map[0] == 0)
+            list_push(&heap->fast_full, list_pop(list));
+    }
+    return done;
+}
+
 static inline void *malloc_tiny(size_t size) {
-    if (size <= 32)
-        // size = 32;
+    if (size <= FAST_CHUNK)
         return malloc_fast();
 
-    size_t index = (size - 1) / 16;
-    size = (index + 1) * 16; // Align to 16 bytes.
+    size_t index = tiny_index(size);
+    size = class_size[index];
 
     void *data = tiny_allocate(index);
     if (data != (void *)0) return data;
@@ -299,7 +518,7 @@ static inline void *malloc_tiny(size_t size) {
 }
 
 static inline void *malloc_middle(size_t size) {
-    size_t index = size <= 640 ? (size + 1535) / 64 : 34 + (size - 513) / 256;
+    size_t index = get_index(size);
 
     void *data = iterative_allocate(index, size, 4);
     if (data != (void *)0) return data;
@@ -308,10 +527,230 @@ static inline void *malloc_middle(size_t size) {
 }
 
 static inline void *malloc_huge(size_t size) {
-    size_t index = size < 6144 ? 48 : (size - 1) / 4096 + 48;
+    size_t index = get_index(size);
 
     void *data = iterative_allocate(index, size, 8);
     if (data != (void *)0) return data;
 
     return next_allocate(index, size);
 }
+
+/**
+ * @brief Take an extremely large chunk out of slot 0,
+ * or from the brk if no chunk fits in a few attempts.
+ * @return Pack of the chunk, out of any list.
+ * nullptr if out of memory.
+ */
+static inline struct pack *extreme_chunk(size_t size) {
+    struct node *node = slot_fit(0, size, 8);
+    if (node == (struct node *)0) return extend_brk(size);
+
+    safe_remove(node, 0);
+    return list_pack(node);
+}
+
+/**
+ * @brief Allocate a chunk in an anonymous mapping of its own.
+ * @return Data pointer. nullptr if mmap failed.
+ * @note The chunk is marked with MMAP_INUSE, and its size
+ * is the length of the whole mapping.
+ */
+static inline void *malloc_mmap(size_t size) {
+    size_t len = (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    void *addr = mmap(0, len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS);
+    if (addr == (void *)-1) return 0;
+    usage_map(len);
+
+    struct pack *pack = (struct pack *)addr;
+    pack_set_prev(pack, 0);
+    pack_set_info(pack, len, MMAP_INUSE);
+    return pack->data;
+}
+
+/**
+ * @brief Allocate an extremely large chunk. A heap in a fixed
+ * region keeps all its chunks inside the region.
+ */
+static inline void *malloc_extreme(size_t size) {
+    if (size > MAX_CHUNK) return 0;
+    if (heap->grow != grow_fixed) {
+        void *data = malloc_mmap(size);
+        if (data != (void *)0) return data;
+    }
+
+    struct pack *pack = extreme_chunk(size);
+    if (pack == (struct pack *)0) return 0;
+    return try_split_allocate(pack, size);
+}
+
+/**
+ * @brief Chunk size for a request of size bytes.
+ * @return 0 if the chunk is larger than MAX_CHUNK.
+ */
+static inline size_t chunk_size(size_t size) {
+    size = ALIGN(size) + sizeof(struct pack);
+    return size > MAX_CHUNK ? 0 : size;
+}
+
+/**
+ * @brief Allocate memory of any size.
+ * @param size Chunk size, including the header.
+ */
+static inline void *malloc_chunk(size_t size) {
+    if (size <= TINY_MAX) {
+        return malloc_tiny(size);
+    } else if (size > HUGE_MAX) {
+        return malloc_extreme(size);
+    } else if (size > MIDDLE_MAX) {
+        return malloc_huge(size);
+    } else {
+        return malloc_middle(size);
+    }
+}
+
+/**
+ * @brief Distance from data to the first aligned address
+ * that leaves room for a free chunk in front of it.
+ * @param align Alignment, a power of 2.
+ */
+static inline size_t align_lead(size_t data, size_t align) {
+    size_t lead = (0 - data) & (align - 1);
+    while (lead != 0 && lead < 48) lead += align;
+    return lead;
+}
+
+/**
+ * @brief Allocate aligned memory from a pack. Both the
+ * leading and the trailing slack go back to the slots.
+ * @param pack Pointer to the pack.
+ * @param need Required size. At least 48.
+ * @param align Alignment of the data, a power of 2.
+ * @return Data pointer. Never return NULL.
+ * @attention Same as try_split_allocate. In addition, the
+ * pack should be large enough for the leading slack.
+ */
+static inline void *
+align_allocate(struct pack *__restrict pack, size_t need, size_t align) {
+    size_t lead = align_lead((size_t)pack->data, align);
+    size_t size = pack_size(pack) - lead;
+    IMPOSSIBLE(pack_size(pack) < lead + need);
+
+    struct pack *temp = (struct pack *)((size_t)pack + lead);
+    if (lead != 0) {
+        pack_set_info(pack, lead, PREV_INUSE);
+        pack_set_prev(temp, lead);
+        pack_set_info(temp, size, BOTH_INUSE);
+    }
+
+    void *data = size - need >= 48 ?
+        split_allocate(temp, need) : pack_allocate(temp);
+
+    if (lead != 0) {
+        pack_clr_meta(temp, PREV_INUSE);
+        free_chunk(pack);
+    }
+    return data;
+}
+
+/**
+ * @brief Allocate aligned memory of any size.
+ * A chunk large enough for any leading slack is taken
+ * from the slots. Otherwise, the heap grows, and since
+ * base is page-aligned, the new memory is aligned too.
+ * @param size Chunk size, including the header.
+ * @param align Alignment, a power of 2, larger than 8.
+ */
+static inline void *aligned_malloc(size_t size, size_t align) {
+    if (size < 48) size = 48;
+    size_t worst = size + align + 48;
+
+    struct pack *pack = (struct pack *)0;
+    if (worst > HUGE_MAX) {
+        struct node *list = heap->slots;
+        for (struct node *node = list->next; node != list; node = node->next) {
+            if (pack_size(list_pack(node)) >= worst) {
+                safe_remove(node, 0);
+                pack = list_pack(node);
+                break;
+            }
+        }
+    } else {
+        uint64_t lowbit = next_free(get_index(worst));
+        if (lowbit != 0)
+            pack = list_pack(list_extract(ctz64(lowbit)));
+    }
+
+    if (pack == (struct pack *)0) {
+        /* Only the lead behind a free tail may be needed. */
+        size_t grow = align <= PAGE_SIZE ? size : worst;
+        pack = extend_brk(grow);
+        if (pack == (struct pack *)0) return 0;
+
+        /* A new segment does not start aligned. */
+        size_t lead = align_lead((size_t)pack->data, align);
+        if (pack_size(pack) < lead + size) {
+            free_chunk(pack);
+            pack = extend_brk(worst);
+            if (pack == (struct pack *)0) return 0;
+        }
+    }
+
+    return align_allocate(pack, size, align);
+}
+
+/**
+ * @brief Allocate zero-filled memory.
+ * Only the part below the fresh mark may have been
+ * touched, so the rest is left as sbrk handed it out.
+ * @param size Chunk size, including the header.
+ * @param need Bytes to be zero-filled.
+ */
+static inline void *calloc_chunk(size_t size, size_t need) {
+    size_t mark = heap->fresh;
+    char  *data = malloc_chunk(size);
+    if (data == (char *)0) return 0;
+
+    size_t addr = (size_t)data;
+    if (addr < mark) {
+        size_t used = mark - addr;
+        memset(data, 0, used < need ? used : need);
+    }
+    return data;
+}
+
+/**
+ * @brief Allocate a batch of chunks of the same size.
+ * The exact tiny slot is drained first, and the rest
+ * are carved out of one chunk in a single pass.
+ * @param size Chunk size, including the header.
+ * @return Count of chunks allocated.
+ */
+static inline size_t
+malloc_batch(size_t size, size_t count, void **out) {
+    if (size <= FAST_CHUNK) return fast_allocate_batch(count, out);
+
+    size_t done = 0;
+    if (size <= TINY_MAX) {
+        size_t index = tiny_index(size);
+        size = class_size[index];
+        while (done != count && !list_empty(heap->slots + index))
+            out[done++] = tiny_allocate(index);
+    }
+    if (done == count) return done;
+
+    size_t rest = count - done;
+    size_t need = size * rest;
+    struct pack *pack = need > HUGE_MAX ?
+        extreme_chunk(need) : next_chunk(get_index(need), need);
+
+    if (pack == (struct pack *)0) {
+        /* Fall back to one by one. */
+        while (done != count && (out[done] = malloc_chunk(size)) != 0)
+            ++done;
+        return done;
+    }
+
+    carve_allocate(pack, size, rest, out + done);
+    return count;
+}
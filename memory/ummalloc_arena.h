@@ -0,0 +1,134 @@
+#pragma once
+#include "ummalloc_data.h"
+#include "ummalloc_alloc.h"
+#include "ummalloc_dealloc.h"
+
+/**
+ * Arena layout:
+ *
+ * An arena bump-allocates from blocks taken from its heap.
+ * Objects have no header and are never freed one by one;
+ * a reset gives them all up at once.
+ *
+ *  - Blocks of the arena size are kept over a reset.
+ *  - Requests above a quarter of the block size get a block
+ *    of their own, which goes back to the heap on reset.
+ */
+
+#define ARENA_SIZE 65536 // Default chunk size of a block.
+
+struct block {
+    struct block *next;
+    size_t size;        // Chunk size, including the header.
+    char data[0];
+};
+
+struct arena {
+    char *ptr;              // Next free byte in the current block.
+    char *end;              // End of the current block.
+    struct block *used;     // Blocks in use, the current first.
+    struct block *spare;    // Blocks kept by reset.
+    size_t size;            // Chunk size of a block.
+    struct heap *heap;      // Heap the blocks come from.
+};
+
+/**
+ * @brief Take a block from the heap.
+ * @param size Chunk size, including the header.
+ * @return nullptr if out of memory.
+ */
+static inline struct block *
+block_allocate(struct arena *arena, size_t size) {
+    struct heap *prev = heap;
+    heap = arena->heap;
+    struct block *block = malloc_chunk(size);
+    heap = prev;
+
+    if (block == (struct block *)0) return 0;
+    block->size = size;
+    return block;
+}
+
+/* Give a list of blocks back to the heap. */
+static inline void block_release(struct arena *arena, struct block *block) {
+    struct heap *prev = heap;
+    heap = arena->heap;
+    while (block != (struct block *)0) {
+        struct block *next = block->next;
+        pack_deallocate(list_pack((struct node *)block));
+        block = next;
+    }
+    heap = prev;
+}
+
+/**
+ * @brief Slow path of arena_alloc: the current block is full.
+ * @param size Aligned size of the object.
+ */
+static void *arena_refill(struct arena *arena, size_t size) {
+    struct block *block;
+    size_t room = arena->size - sizeof(struct pack) - sizeof(struct block);
+
+    if (size > room / 4) {
+        /* Large object: a block of its own, behind the current. */
+        block = block_allocate(arena, ALIGN(sizeof(struct block) + size)
+                                      + sizeof(struct pack));
+        if (block == (struct block *)0) return 0;
+        if (arena->used == (struct block *)0) {
+            block->next = 0;
+            arena->used = block;
+        } else {
+            block->next = arena->used->next;
+            arena->used->next = block;
+        }
+        return block->data;
+    }
+
+    if (arena->spare != (struct block *)0) {
+        block = arena->spare;
+        arena->spare = block->next;
+    } else {
+        block = block_allocate(arena, arena->size);
+        if (block == (struct block *)0) return 0;
+    }
+
+    block->next = arena->used;
+    arena->used = block;
+    arena->ptr = block->data + size;
+    arena->end = block->data + room;
+    return block->data;
+}
+
+/**
+ * @brief Allocate size bytes from the arena, 8 bytes aligned.
+ *        A size of 0 still gets a distinct object.
+ * @return nullptr if out of memory.
+ */
+static inline void *arena_alloc(struct arena *arena, size_t size) {
+    size = size == 0 ? ALIGNMENT : ALIGN(size);
+    if (size <= (size_t)(arena->end - arena->ptr)) {
+        arena->ptr += size;
+        return arena->ptr - size;
+    }
+    return arena_refill(arena, size);
+}
+
+/* Free all objects. Blocks of the arena size are kept. */
+static inline void arena_reset(struct arena *arena) {
+    struct block *large = 0;
+    struct block *block = arena->used;
+    while (block != (struct block *)0) {
+        struct block *next = block->next;
+        if (block->size == arena->size) {
+            block->next = arena->spare;
+            arena->spare = block;
+        } else {
+            block->next = large;
+            large = block;
+        }
+        block = next;
+    }
+    block_release(arena, large);
+    arena->used = 0;
+    arena->ptr = arena->end = 0;
+}
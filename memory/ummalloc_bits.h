@@ -0,0 +1,65 @@
+#pragma once
+#include "ummalloc_decl.h"
+
+/**
+ * Bit scans for the slot bitmap and the fast pages.
+ *
+ * With the Zbb extension (make ZBB=1) the builtins are single
+ * clz/ctz instructions. A plain RV64GC build would turn them
+ * into calls to libgcc, which user programs do not link, so
+ * it keeps the branchless shift cascade instead.
+ */
+
+/**
+ * @brief Count leading zeros by halving the range six times.
+ * @example
+ *  1 -> 63, 2 -> 62, 3 -> 62, 0 -> 64
+*/
+static inline size_t clz64_soft(size_t x) {
+    size_t t = 0, p = 0;
+
+    p = (x >> 32 != 0) << 5;
+    t += p; x >>= p;
+
+    p = (x >> 16 != 0) << 4;
+    t += p; x >>= p;
+
+    p = (x >> 8  != 0) << 3;
+    t += p; x >>= p;
+
+    p = (x >> 4  != 0) << 2;
+    t += p; x >>= p;
+
+    p = (x >> 2  != 0) << 1;
+    t += p; x >>= p;
+
+    // 0 -> 64 ; 1 -> 63 ; 2 -> 62; 3 -> 62
+    return 64 - t - x + (x == 3);
+}
+
+/**
+ * @brief Count trailing zeros.
+ * @example
+ *  1 -> 0, 8 -> 3, 12 -> 2
+*/
+static inline size_t ctz64_soft(size_t x) {
+    return 63 - clz64_soft(x & -x);
+}
+
+#if defined(__riscv_zbb) || !defined(__riscv)
+/* x should not be 0. */
+static inline size_t clz64(size_t x) { return __builtin_clzll(x); }
+static inline size_t ctz64(size_t x) { return __builtin_ctzll(x); }
+#else
+static inline size_t clz64(size_t x) { return clz64_soft(x); }
+static inline size_t ctz64(size_t x) { return ctz64_soft(x); }
+#endif
+
+/**
+ * @brief Calculate the floor of log2(x). x should not be 0.
+ * @example
+ *  1 -> 0, 2 -> 1, 3 -> 1, 4 -> 2
+*/
+static inline size_t log2_floor64(size_t x) {
+    return 63 - clz64(x);
+}
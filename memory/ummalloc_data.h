@@ -19,16 +19,28 @@
  * ------------------------     <--- Low address of the heap
  * 
  * Slot memory layout:
- *  - Slot 00 ~ 00: Reserved for extremely large memory.
+ *  - Slot 00 ~ 00: ( 65536, +inf )                        Dynamic size.
  *  - Slot 01 ~ 01: { 32 }                                  Fixed size.
  *  - Slot 02 ~ 31: [48    , 512   ]   step 16 bytes.       Fixed size.
- *  - Slot 32 ~ 33: {576   , 640   }   step 64 bytes.       Dynamic size.
- *  - Slot 34 ~ 47: [768   , 4096  ]   step 256 bytes.      Dynamic size.
- *  - Slot 48 ~ 48: { 6144 }                                Dynamic size.
- *  - Slot 49 ~ 63: [8191  , 65536 ]   step 4096 bytes.     Dynamic size.
+ *  - Slot 32 ~ 34: (512   , 768   ]   up to 576, 640, 768. Dynamic size.
+ *  - Slot 35 ~ 47: (768   , 4096  ]   step 256 bytes.      Dynamic size.
+ *  - Slot 48 ~ 63: (4096  , 65536 ]   4 per power of 2.    Dynamic size.
+ *
+ * Slots 01 ~ 47 come from the SLOTS list below, through a
+ * table indexed by size / 8. Huge slots are computed from
+ * log2. The bounds are named in ummalloc_decl.h.
  * 
+ * Extremely large chunks are first served by mmap, each in
+ * a region of its own, and unmapped as soon as they are freed.
+ * Only when mmap fails do they come from slot 0 or the brk.
+ * 
+ * All the state above lives in a struct heap. mm_malloc
+ * uses main_heap, which grows by sbrk. Other heaps grow
+ * inside a fixed region or by mmap, and are switched in
+ * through the heap pointer for the length of each call.
+ *
  * Summary:
- *  - Extreme:  [0x00, 0x01)    # Not implemented yet.
+ *  - Extreme:  [0x00, 0x01)
  *  - Fast:     [0x01, 0x02)
  *  - Tiny:     [0x02, 0x20)
  *  - Middle:   [0x20, 0x30)
@@ -36,65 +48,118 @@
 */
 
 #include "user/user.h"
+#include "kernel/fcntl.h"
 #include "ummalloc_decl.h"
+#include "ummalloc_bits.h"
 
-/**
- * @brief Calculate the ceil of log2(x).
- * @example
- *  63 -> 6, 64 -> 6, 65 -> 7, 0 -> 64
-*/
-static inline size_t log2_ceil64(size_t x) {
-    x = x - 1;
-    size_t t = 0, p = 0;
-
-    p = (x >> 32 != 0) << 5;
-    t += p; x >>= p;
-
-    p = (x >> 16 != 0) << 4;
-    t += p; x >>= p;
-
-    p = (x >> 8  != 0) << 3;
-    t += p; x >>= p;
-
-    p = (x >> 4  != 0) << 2;
-    t += p; x >>= p;
-
-    p = (x >> 2  != 0) << 1;
-    t += p; x >>= p;
-
-    // 0 -> 0 ; 1 -> 1 ; 2 -> 2; 3 -> 2
-    return t + x + (x < 3) - 1;
-}
+struct heap;
 
+/**
+ * @brief Get size more bytes of memory for a heap, like sbrk.
+ * @return Start of the memory. (char *)-1 if there is none.
+ */
+typedef char *(*grow_t)(struct heap *, size_t);
+
+struct heap {
+    struct node *base;      // Base address of the heap.
+    uint64_t    bitmap;     // Bitmap for all slots.
+    struct node fast_full;  // Fast slot for those full.
+    struct node slots[64];  // 64 slots for different size.
+    size_t      fresh;      // Memory above has never been touched.
+    grow_t      grow;       // Where more memory comes from.
+    size_t      brk;        // Break of a region, for grow_fixed.
+    size_t      end;        // End of a region, for grow_fixed.
+    size_t      step;       // Size of each mapping, for grow_mmap.
+    size_t      ahead;      // Least growth of the top, adaptive.
+    size_t      total;      // Memory got from grow so far.
+};
+
+static char *grow_sbrk(struct heap *, size_t);
+
+/* Static: ULIB links this file into every user program. */
+static struct heap main_heap = { .grow = grow_sbrk };   // The heap of mm_malloc.
+static struct heap *heap = &main_heap;                  // The heap in use.
 
 /**
- * @brief Calculate the floor of log2(x).
- * @example
- *  1 -> 0, 2 -> 1, 3 -> 1, 4 -> 2
-*/
-static inline size_t log2_floor64(size_t x) {
-    return log2_ceil64(x + 1) - 1;
+ * Memory taken from the kernel, for mm_peak_footprint:
+ * the heap below the break and all mappings, whether for
+ * extremely large chunks or for other heaps. Trimming and
+ * unmapping lower it, so the peak is kept apart.
+ */
+struct usage {
+    size_t start;   // Break when mm_init ran.
+    size_t brk;     // Break now.
+    size_t mapped;  // Bytes mapped now.
+    size_t peak;    // Highest footprint so far.
+};
+
+static struct usage usage;
+
+static inline void usage_update(void) {
+    size_t now = usage.brk - usage.start + usage.mapped;
+    if (now > usage.peak) usage.peak = now;
 }
 
-struct node *base;      // Base address of the heap.
-uint64_t    bitmap;     // Bitmap for all slots.
-struct node fast_full;  // Fast slot for those full.
-struct node slots[64];  // 64 slots for different size.
+/* Count len more bytes as mapped, or fewer if negative. */
+static inline void usage_map(long len) {
+    usage.mapped += len;
+    usage_update();
+}
 
-static void *malloc_brk(size_t);
+static struct pack *extend_brk(size_t);
 static void  free_chunk(struct pack *);
 static struct pack *try_merge_prev(struct pack * __restrict);
 static struct pack *try_merge_next(struct pack * __restrict);
 
-static inline uint64_t next_free(size_t size) {
-    uint64_t mask = bitmap;
-    uint64_t temp = -1;
-    mask &= temp << (size + 1);
+/**
+ * @brief Find the lowest non-empty slot above index.
+ * Extremely large chunks are larger than any other
+ * chunk, so slot 0 is taken as the last resort.
+ * @return Lowbit of that slot. 0 if not found.
+ */
+static inline uint64_t next_free(size_t index) {
+    uint64_t mask = heap->bitmap;
+    uint64_t temp = -2;
+    mask &= temp << index;
+    if (mask == 0) return heap->bitmap & 1;
     return mask & (-mask);
 }
 
-static inline void bitmap_set(size_t index) { bitmap |= 1ull << index; }
-static inline void bitmap_clr(size_t index) { bitmap &= ~(1ull << index); }
+/**
+ * @brief Record that memory below end has been touched.
+ * Memory from sbrk is zero-filled by the kernel, so
+ * anything at or above the fresh mark is still zero.
+ */
+static inline void fresh_mark(size_t end) {
+    if (heap->fresh < end) heap->fresh = end;
+}
+
+static inline void bitmap_set(size_t index) { heap->bitmap |= 1ull << index; }
+static inline void bitmap_clr(size_t index) { heap->bitmap &= ~(1ull << index); }
+
+/**
+ * @brief Put a free node into a slot. Under PLACE_ADDRESS the
+ * slot is kept sorted by address near its front, where the
+ * first fit looks: a node above the last one is appended at
+ * once, as the top of a growing heap always is, and any other
+ * goes in order among the first PLACE_WALK nodes, or after
+ * them. Otherwise the node goes first.
+ */
+static inline void slot_insert(struct node *list, struct node *node) {
+#if PLACEMENT == PLACE_ADDRESS
+    struct node *prev = list->prev;
+    if (prev != list && prev > node) {
+        size_t walk = PLACE_WALK;
+        prev = list;
+        while (walk-- != 0 && prev->next != list && prev->next < node)
+            prev = prev->next;
+    }
+    node_link(node, prev->next);
+    node_link(prev, node);
+#else
+    list_push(list, node);
+#endif
+}
 
 /** Safely remove a node from the list. */
 static inline void
@@ -105,15 +170,69 @@ safe_remove(struct node *__restrict node, size_t index) {
     if (prev == next) bitmap_clr(index);
 }
 
+/**
+ * @brief The slots up to MIDDLE_MAX, as X(index, smallest,
+ * largest chunk size). A slot holds chunks from its size up
+ * to the next slot's, so any chunk in a tiny slot is large
+ * enough for the slot. Change a class here and both tables
+ * below follow.
+ */
+#define TINY(i) X(i, (i + 1) * TINY_STEP, (i + 2) * TINY_STEP - 1)
+#define SLOTS                                                   \
+    X(1, FAST_CHUNK, 3 * TINY_STEP - 1)                         \
+    TINY(2)  TINY(3)  TINY(4)  TINY(5)  TINY(6)  TINY(7)        \
+    TINY(8)  TINY(9)  TINY(10) TINY(11) TINY(12) TINY(13)       \
+    TINY(14) TINY(15) TINY(16) TINY(17) TINY(18) TINY(19)       \
+    TINY(20) TINY(21) TINY(22) TINY(23) TINY(24) TINY(25)       \
+    TINY(26) TINY(27) TINY(28) TINY(29) TINY(30)                \
+    X(31, TINY_MAX, TINY_MAX)                                   \
+    X(32, 513,  576)  X(33, 577,  640)  X(34, 641,  768)        \
+    X(35, 769,  1024) X(36, 1025, 1280) X(37, 1281, 1536)       \
+    X(38, 1537, 1792) X(39, 1793, 2048) X(40, 2049, 2304)       \
+    X(41, 2305, 2560) X(42, 2561, 2816) X(43, 2817, 3072)       \
+    X(44, 3073, 3328) X(45, 3329, 3584) X(46, 3585, 3840)       \
+    X(47, 3841, MIDDLE_MAX)
+
+/* Smallest chunk in each slot up to MIDDLE_MAX. */
+static const uint16_t class_size[48] = {
+#define X(index, low, high) [index] = low,
+    SLOTS
+#undef X
+};
+
+/* Slot of each chunk size up to MIDDLE_MAX, indexed by size / 8. */
+static const uint8_t class_table[MIDDLE_MAX / 8 + 1] = {
+#define X(index, low, high) [((low) + 7) / 8 ... (high) / 8] = index,
+    SLOTS
+#undef X
+};
+
+#undef SLOTS
+#undef TINY
+
+/**
+ * @brief Slot of a chunk in (4096, 65536]: four slots per
+ * power of 2, by the top three bits of size - 1.
+ */
+static inline size_t huge_index(size_t size) {
+    size_t shift = log2_floor64(size - 1);
+    return 48 + (shift - 12) * 4 + (((size - 1) >> (shift - 2)) & 3);
+}
+
+/* Index of the slot a free chunk belongs to. */
 static inline size_t get_index(size_t size) {
-    size_t index = 0;
-    if (size <= 512) {
-        IMPOSSIBLE(size <= 32);
-        index = (size - 1) / 16;
-    } else if (size > 4096) {
-        index = size < 6144 ? 48 : (size - 1) / 4096 + 48;
-    } else {
-        index = size <= 640 ? (size + 1535) / 64 : 34 + (size - 513) / 256;
-    }
-    return index;
+    IMPOSSIBLE(size <= FAST_CHUNK);
+    if (size <= MIDDLE_MAX) return class_table[size / 8];
+    if (size > HUGE_MAX) return 0;
+    return huge_index(size);
+}
+
+/**
+ * @brief Tiny slot whose chunks all fit size, for size in
+ * (FAST_CHUNK, TINY_MAX]: the slot of size itself, unless
+ * size is above that slot's chunks.
+ */
+static inline size_t tiny_index(size_t size) {
+    size_t index = class_table[size / 8];
+    return class_size[index] < size ? index + 1 : index;
 }
@@ -17,11 +17,12 @@ static inline void free_chunk(struct pack *pack) {
     size_t size = pack_size(pack);
     size_t index = get_index(size);
 
-    struct node *list = &slots[index];
+    struct node *list = &heap->slots[index];
     struct node *node = (struct node *)pack->data;
-    list_push(list, node);
+    slot_insert(list, node);
+    fresh_mark((size_t)(node + 1));
 
-    bitmap |= 1ull << index;
+    heap->bitmap |= 1ull << index;
 }
 
 static inline void
@@ -59,3 +60,187 @@ try_merge_prev(struct pack * __restrict pack) {
 
     return prev;
 }
+
+/**
+ * @brief Try to merge a chunk with its next chunk.
+ * @param pack Chunk to be merged.
+ * @return Pack of the merged chunk.
+ * @attention First, the pack must be out of any list.
+ * In addition, previous chunk of current chunk must be in use.
+ * Also, bit flags of the merged chunk will be unchanged.
+ */
+static inline struct pack *
+try_merge_next(struct pack * __restrict pack) {
+    struct pack *next = pack_next(pack);
+    enum Meta meta = pack_meta(next);
+    if (meta & THIS_INUSE) return pack;
+
+    struct node *node = (struct node *)next->data;
+
+    try_safe_remove(node, next);
+    prev_add_size(pack, pack_size(next));
+    next = pack_next(pack);
+    pack_set_prev(next, pack_size(pack));
+
+    return pack;
+}
+
+/**
+ * @brief Give the whole pages of a freed range back to the kernel.
+ * A free neighbour of DISCARD_SIZE or more was discarded when
+ * it was freed, so only [start, end) and smaller neighbours are;
+ * a small free next to a large hole usually covers no page.
+ * The list node at the front and the next header stay mapped.
+ * The pages read as zero next time, but calloc still clears
+ * them: the fresh mark only covers the untouched top.
+ * Not used in fixed regions, which the caller owns.
+ * @param pack Free chunk, already merged with its neighbours.
+ * @param start Start of the freed chunk, before merging.
+ * @param end End of the freed chunk, before merging.
+ */
+static inline void discard_chunk(struct pack *pack, size_t start, size_t end) {
+    size_t lo = (size_t)pack->data + sizeof(struct node);
+    size_t hi = (size_t)pack_next(pack);
+    if (start - (size_t)pack >= DISCARD_SIZE && start > lo) lo = start;
+    if (end < hi && hi - end >= DISCARD_SIZE) hi = end;
+    lo = (lo + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+    hi &= ~(size_t)(PAGE_SIZE - 1);
+    if (lo < hi) madvise((void *)lo, hi - lo, MADV_DONTNEED);
+}
+
+/**
+ * @brief Give the top of an sbrk heap back to the kernel when
+ * the free chunk there reaches TRIM_SIZE, keeping half of it.
+ * The heap has stopped growing, so the growth step starts over.
+ * @param pack Free chunk, already merged with its neighbours.
+ */
+static inline void trim_top(struct pack *pack) {
+    size_t size = pack_size(pack);
+    if (size < TRIM_SIZE || pack_next(pack) != list_pack(heap->base)) return;
+    if (heap->grow != grow_sbrk || sbrk(0) != (char *)heap->base) return;
+
+    size_t cut = (size - TRIM_SIZE / 2) & ~(size_t)(PAGE_SIZE - 1);
+    if (cut > 0x7FFFFFFF || sbrk(-(int)cut) == (char *)-1) return;
+    usage.brk -= cut;
+
+    heap->base = (struct node *)((size_t)heap->base - cut);
+    heap->total -= cut;
+    heap->ahead = PAGE_SIZE;
+    if (heap->fresh > (size_t)heap->base)
+        heap->fresh = (size_t)heap->base; // Zero when it comes back.
+
+    size -= cut;
+    pack_set_size(pack, size);
+    struct pack *tail = pack_next(pack);
+    pack_set_prev(tail, size);
+    pack_set_info(tail, TAIL, THIS_INUSE);
+}
+
+/**
+ * @brief Free a chunk allocated from the slots.
+ * It will be merged with its free neighbors.
+ * @param pack Chunk to be freed. Size > 32.
+ */
+static inline void free_pack(struct pack *pack) {
+    struct pack *next = pack_next(pack);
+    size_t start = (size_t)pack, end = (size_t)next;
+    pack_clr_meta(next, PREV_INUSE);
+    pack_clr_meta(pack, THIS_INUSE);
+    pack = try_merge_next(try_merge_prev(pack));
+    trim_top(pack);
+    /* The merged size, so that small neighbours of a large
+     * freed chunk release their pages too. */
+    if (pack_size(pack) >= DISCARD_SIZE && heap->grow != grow_fixed)
+        discard_chunk(pack, start, end);
+    return free_chunk(pack);
+}
+
+/**
+ * @brief Give a fast chunk back to its page.
+ * A page that was full is linked back to the fast slot.
+ * @param pack Chunk to be freed. Size = 32.
+ */
+static inline void fast_deallocate(struct pack *pack) {
+    size_t index = pack->prev;
+    size_t *map = (size_t *)((size_t)pack - index * 32) - 3;
+    map[1 + index / 64] |= 1ull << (index % 64);
+
+    if (map[0]++ != 0) return;
+
+    struct node *node = (struct node *)map - 1;
+    list_erase(node);
+    list_push(heap->slots + 1, node);
+}
+
+/* Give a chunk from malloc_mmap back to the kernel. */
+static inline void mmap_deallocate(struct pack *pack) {
+    usage_map(-(long)pack_size(pack));
+    munmap(pack, pack_size(pack));
+}
+
+/* Free a chunk of any kind. */
+static inline void pack_deallocate(struct pack *pack) {
+    if (pack_size(pack) == 32)
+        return fast_deallocate(pack);
+    else if (pack_meta(pack) & RESERVED)
+        return mmap_deallocate(pack);
+    else
+        return free_pack(pack);
+}
+
+/**
+ * @brief Sort the pointers by address (shell sort).
+ * @note Null pointers are moved to the front.
+ */
+static inline void sort_address(void **ptrs, size_t count) {
+    size_t gap = 1;
+    while (gap < count / 3) gap = gap * 3 + 1;
+
+    for (; gap != 0; gap /= 3) {
+        for (size_t i = gap; i < count; ++i) {
+            void *temp = ptrs[i];
+            size_t j = i;
+            for (; j >= gap && ptrs[j - gap] > temp; j -= gap)
+                ptrs[j] = ptrs[j - gap];
+            ptrs[j] = temp;
+        }
+    }
+}
+
+/**
+ * @brief Free a batch of pointers in one sweep.
+ * Address-adjacent chunks are joined before being
+ * freed, so each run touches the slots only once.
+ * @attention The pointers will be sorted in place.
+ */
+static inline void free_batch(void **ptrs, size_t count) {
+    sort_address(ptrs, count);
+
+    size_t i = 0;
+    while (i != count && ptrs[i] == (void *)0) ++i;
+
+    while (i != count) {
+        struct pack *pack = list_pack(ptrs[i++]);
+        size_t size = pack_size(pack);
+        if (size == 32) {
+            fast_deallocate(pack);
+            continue;
+        }
+        if (pack_meta(pack) & RESERVED) {
+            mmap_deallocate(pack);
+            continue;
+        }
+
+        /* Join the run of adjacent chunks behind. */
+        struct pack *next = pack_next(pack);
+        while (i != count && list_pack(ptrs[i]) == next) {
+            size += pack_size(next);
+            next = pack_next(next);
+            ++i;
+        }
+
+        pack_set_size(pack, size);
+        pack_set_prev(next, size);
+        free_pack(pack);
+    }
+}
@@ -3,6 +3,46 @@
 #define PAGE_SIZE 4096
 #endif
 
+/* placement within a slot, chosen at build time */
+#define PLACE_LIFO      0   // Freed chunks go first, take the first fit.
+#define PLACE_ADDRESS   1   // Slots sorted by address, take the first fit.
+#define PLACE_BEST      2   // Freed chunks go first, take the smallest fit.
+#ifndef PLACEMENT
+#define PLACEMENT PLACE_LIFO
+#endif
+
+/* PLACE_ADDRESS looks at no more than this many nodes of a slot
+ * for the place of a freed chunk */
+#ifndef PLACE_WALK
+#define PLACE_WALK 16
+#endif
+
+/* the top of the heap grows by at most this much beyond the need */
+#ifndef GROW_MAX
+#define GROW_MAX 65536
+#endif
+
+/* a free chunk this large at the top of the heap is trimmed */
+#ifndef TRIM_SIZE
+#define TRIM_SIZE 131072
+#endif
+
+/* freeing a chunk at least this large gives its pages back */
+#ifndef DISCARD_SIZE
+#define DISCARD_SIZE 65536
+#endif
+
+/* chunk size bounds of the slot classes; see ummalloc_data.h */
+#define FAST_CHUNK  32      // The one size of a fast chunk.
+#define TINY_STEP   16      // Tiny slots hold a size each, this far apart.
+#define TINY_MAX    512     // Largest tiny chunk.
+#define MIDDLE_MAX  4096    // Largest chunk found through class_table.
+#define HUGE_MAX    65536   // Largest chunk in a slot; above is extreme.
+
+/* the largest chunk, so that its size rounded up to pages
+ * still fits the 32-bit header */
+#define MAX_CHUNK (0xFFFFFFFFu - PAGE_SIZE)
+
 /* single word (4) or double word (8) alignment */
 #define ALIGNMENT 8
 /* rounds up to the nearest multiple of ALIGNMENT */
@@ -17,6 +57,7 @@
 #define IMPOSSIBLE(x) do { if(x) { printf("\nImpossible!\n"); exit(1); } } while(0)
 #endif // IMPOSSIBLE
 
+typedef unsigned char       uint8_t;
 typedef unsigned short      uint16_t;
 typedef unsigned int        uint32_t;
 typedef unsigned long long  uint64_t;
@@ -39,6 +80,7 @@ enum Meta {
     THIS_INUSE  = 0b010,
     BOTH_INUSE  = 0b011,
     RESERVED    = 0b100,
+    MMAP_INUSE  = 0b110,    // A chunk in its own mmap region.
     FULL_MASK   = 0b111,
 };
 
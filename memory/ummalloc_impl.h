@@ -3,3 +3,5 @@
 #include "ummalloc_data.h"
 #include "ummalloc_alloc.h"
 #include "ummalloc_dealloc.h"
+#include "ummalloc_realloc.h"
+#include "ummalloc_arena.h"
@@ -0,0 +1,136 @@
+#pragma once
+#include "ummalloc_data.h"
+#include "ummalloc_alloc.h"
+#include "ummalloc_dealloc.h"
+
+/* Bytes of user memory in a chunk. */
+static inline size_t pack_usable(struct pack *pack) {
+    return pack_size(pack) - sizeof(struct pack);
+}
+
+/**
+ * @brief Try to grow a chunk in use to at least need bytes,
+ * by taking the free chunk behind and then the heap top.
+ * @return 1 if the chunk is large enough now, 0 otherwise.
+ * @attention A free next chunk is always merged, so that the
+ * chunk behind is in use (with PREV_INUSE set) on return.
+ */
+static inline int
+try_expand(struct pack *__restrict pack, size_t need) {
+    struct pack *next = pack_next(pack);
+    if (!(pack_meta(next) & THIS_INUSE)) {
+        try_merge_next(pack);
+        next = pack_next(pack);
+        pack_add_meta(next, PREV_INUSE);
+    }
+
+    size_t size = pack_size(pack);
+    if (size >= need) return 1;
+    if (next != list_pack(heap->base)) return 0;
+
+    /* The chunk lies right below the top. Grow in place. */
+    struct pack *tail = extend_brk(need - size);
+    if (tail == (struct pack *)0) return 0;
+    if (tail != next) return free_chunk(tail), 0; // A new segment.
+
+    prev_add_size(pack, pack_size(tail));
+    next = pack_next(pack);
+    pack_set_prev(next, pack_size(pack));
+    return 1;
+}
+
+/**
+ * @brief Resize a chunk in use, in place if possible.
+ * @param pack Chunk in use. Size > 32.
+ * @param need Required size. Size > 32.
+ * @return Data pointer. nullptr if out of memory,
+ * in which case the chunk is left untouched.
+ */
+static inline void *
+realloc_chunk(struct pack *__restrict pack, size_t need) {
+    if (need < 48) need = 48;
+
+    if (try_expand(pack, need)) {
+        enum Meta meta = pack_meta(pack);
+        size_t rest = pack_size(pack) - need;
+        void *data = rest >= 48 ?
+            split_allocate(pack, need) : pack_allocate(pack);
+        if (!(meta & PREV_INUSE)) pack_clr_meta(pack, PREV_INUSE);
+        return data;
+    }
+
+    void *data = malloc_chunk(need);
+    if (data == (void *)0) return 0;
+
+    memmove(data, pack->data, pack_usable(pack));
+    free_pack(pack);
+    return data;
+}
+
+/**
+ * @brief Resize a chunk from malloc_mmap. It shrinks in place
+ * by unmapping the tail, as long as it stays extremely large,
+ * so that the sized free of the new size finds the right class.
+ * It grows with mremap, which moves the pages instead of the bytes.
+ * @param size Chunk size, including the header.
+ */
+static inline void *
+realloc_mmap(struct pack *__restrict pack, size_t size) {
+    size_t used = pack_size(pack);
+    size_t len = (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    if (size > HUGE_MAX && size <= used) {
+        if (len < used) {
+            munmap((char *)pack + len, used - len);
+            usage_map(-(long)(used - len));
+            pack_set_size(pack, len);
+        }
+        return pack->data;
+    }
+
+    if (size > used) {
+        void *addr = mremap(pack, used, len, MREMAP_MAYMOVE);
+        if (addr != (void *)-1) {
+            usage_map(len - used);
+            pack = (struct pack *)addr;
+            pack_set_size(pack, len);
+            return pack->data;
+        }
+    }
+
+    void *data = malloc_chunk(size);
+    if (data == (void *)0) return 0;
+
+    size_t copy = pack_usable(pack);
+    if (copy > size - sizeof(struct pack))
+        copy = size - sizeof(struct pack);
+    memmove(data, pack->data, copy);
+    mmap_deallocate(pack);
+    return data;
+}
+
+/**
+ * @brief Resize any chunk. Chunks that shrink to the
+ * fast size move to a fast page, so that the sized free
+ * of the new size always finds the right class.
+ * @param size Chunk size, including the header.
+ */
+static inline void *
+realloc_pack(struct pack *__restrict pack, size_t size) {
+    size_t used = pack_size(pack);
+    if (pack_meta(pack) & RESERVED)
+        return realloc_mmap(pack, size);
+    if (used != 32 && size > 32)
+        return realloc_chunk(pack, size);
+    if (used == 32 && size <= 32)
+        return pack->data;
+
+    void *data = malloc_chunk(size);
+    if (data == (void *)0) return 0;
+
+    size_t copy = pack_usable(pack);
+    if (copy > size - sizeof(struct pack))
+        copy = size - sizeof(struct pack);
+    memmove(data, pack->data, copy);
+    pack_deallocate(pack);
+    return data;
+}
@@ -0,0 +1,65 @@
+// Compare the shift-cascade bit scans of the allocator with
+// the compiler builtins, which are single clz/ctz instructions
+// under make ZBB=1. Without Zbb the builtins would be libgcc
+// calls, which user programs do not link, so only the shift
+// cascade is timed.
+
+#include "kernel/types.h"
+#include "user/user.h"
+#include "memory/ummalloc_bits.h"
+
+#define N (1 << 22)
+
+static uint64 seed = 88172645463325252ull;
+
+static uint64
+next(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+// Time N scans with scan, inlined, of values from value(i).
+#define BENCH(name, scan, value) ({                             \
+  uint64 sum = 0, start;                                        \
+  seed = 88172645463325252ull;                                  \
+  start = getclk();                                             \
+  for(int i = 0; i < N; i++)                                    \
+    sum += scan(value(i));                                      \
+  start = getclk() - start;                                     \
+  printf("%s: %l clock ticks for %d scans\n", name, start, N); \
+  sum;                                                          \
+})
+
+// Random values with any count of leading or trailing zeros.
+#define HIGH(i) ((next() | 1ull << 63) >> ((i) & 63))
+#define LOW(i)  ((next() | 1) << ((i) & 63))
+
+#ifdef __riscv_zbb
+#define ZBB "with Zbb"
+#else
+#define ZBB "without Zbb"
+#endif
+
+#define CLZ(x) __builtin_clzll(x)
+#define CTZ(x) __builtin_ctzll(x)
+
+int
+main(void)
+{
+  printf("bitbench: built " ZBB "\n");
+#if defined(__riscv_zbb) || !defined(__riscv)
+  if(BENCH("clz64_soft", clz64_soft, HIGH) != BENCH("clz builtin", CLZ, HIGH) ||
+     BENCH("ctz64_soft", ctz64_soft, LOW) != BENCH("ctz builtin", CTZ, LOW)){
+    printf("bitbench: results differ\n");
+    exit(1);
+  }
+#else
+  BENCH("clz64_soft", clz64_soft, HIGH);
+  BENCH("ctz64_soft", ctz64_soft, LOW);
+  printf("bitbench: no builtins to compare; run make ZBB=1\n");
+#endif
+  exit(0);
+}
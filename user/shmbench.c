@@ -0,0 +1,119 @@
+// Pass SIZE bytes from a child to its parent ROUNDS times,
+// through a pipe and through a shared memory segment.
+
+#include "kernel/types.h"
+#include "kernel/shm.h"
+#include "user/user.h"
+
+#define SIZE   (64 * 1024)
+#define ROUNDS 16
+
+static char buf[SIZE];
+
+static void
+fill(char *p, int round)
+{
+  for(int i = 0; i < SIZE; i += 512)
+    p[i] = round + i / 512;
+}
+
+static int
+check(char *p, int round)
+{
+  for(int i = 0; i < SIZE; i += 512)
+    if(p[i] != (char)(round + i / 512))
+      return -1;
+  return 0;
+}
+
+static uint64
+bypipe(void)
+{
+  int fds[2], n;
+  uint64 start;
+
+  if(pipe(fds) < 0){
+    printf("shmbench: pipe failed\n");
+    exit(1);
+  }
+  start = getclk();
+  if(fork() == 0){
+    close(fds[0]);
+    for(int r = 0; r < ROUNDS; r++){
+      fill(buf, r);
+      write(fds[1], buf, SIZE);
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  for(int r = 0; r < ROUNDS; r++){
+    for(int got = 0; got < SIZE; got += n){
+      if((n = read(fds[0], buf + got, SIZE - got)) <= 0){
+        printf("shmbench: short read\n");
+        exit(1);
+      }
+    }
+    if(check(buf, r) < 0){
+      printf("shmbench: pipe data differs\n");
+      exit(1);
+    }
+  }
+  close(fds[0]);
+  wait(0);
+  return getclk() - start;
+}
+
+// Pipes only carry a byte per round each way, to hand the
+// segment over; the data itself is never copied.
+static uint64
+byshm(void)
+{
+  int fds[2], ack[2], id;
+  uint64 start;
+  char *seg, c;
+
+  if((id = shmget(IPC_PRIVATE, SIZE, IPC_CREAT|SHM_R|SHM_W)) < 0 ||
+     (seg = shmat(id, 0, 0)) == (char*)-1){
+    printf("shmbench: shmget/shmat failed\n");
+    exit(1);
+  }
+  shmctl(id, IPC_RMID, 0); // freed once both have detached
+  if(pipe(fds) < 0 || pipe(ack) < 0){
+    printf("shmbench: pipe failed\n");
+    exit(1);
+  }
+  start = getclk();
+  if(fork() == 0){
+    close(fds[0]);
+    close(ack[1]);
+    for(int r = 0; r < ROUNDS; r++){
+      fill(seg, r);
+      write(fds[1], "x", 1);
+      read(ack[0], &c, 1);
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  close(ack[0]);
+  for(int r = 0; r < ROUNDS; r++){
+    if(read(fds[0], &c, 1) != 1 || check(seg, r) < 0){
+      printf("shmbench: shm data differs\n");
+      exit(1);
+    }
+    write(ack[1], "x", 1);
+  }
+  close(fds[0]);
+  close(ack[1]);
+  wait(0);
+  start = getclk() - start;
+  shmdt(seg);
+  return start;
+}
+
+int
+main(void)
+{
+  printf("pipe: %l clock ticks for %d x %d bytes\n", bypipe(), ROUNDS, SIZE);
+  printf("shm:  %l clock ticks for %d x %d bytes\n", byshm(), ROUNDS, SIZE);
+  exit(0);
+}
@@ -4,26 +4,240 @@
 #include "../memory/ummalloc_impl.h"
 
 int mm_init(void) {
+    if (heap == &main_heap) {
+        usage.start = usage.brk = (size_t)sbrk(0);
+        usage.mapped = usage.peak = 0;
+    }
     mm_list_init();
     mm_align_init();
-    return base == 0 ? -1 : 0;
+    return heap->base == 0 ? -1 : 0;
 }
 
 void *mm_malloc(uint size) {
-    size = ALIGN(size) + sizeof(struct pack);
-    if (size <= 512) {
-        return malloc_tiny(size);
-    } else if (size > 4096) {
-        return malloc_huge(size);
-    } else {
-        return malloc_middle(size);
-    }
+    size_t chunk = chunk_size(size);
+    if (chunk == 0) return 0;
+    return malloc_chunk(chunk);
+}
+
+void mm_free(void *ptr) {
+    if (ptr == 0) return;
+    pack_deallocate(list_pack(ptr));
+}
+
+void *mm_calloc(uint count, uint size) {
+    uint64_t need = (uint64_t)count * size;
+    size_t chunk = chunk_size(need);
+    if (chunk == 0) return 0; // Overflow.
+    return calloc_chunk(chunk, need);
+}
+
+void *mm_memalign(uint align, uint size) {
+    if (align == 0 || (align & (align - 1)) != 0) return 0;
+    size_t chunk = chunk_size(size);
+    if (chunk == 0 || chunk + align + 48 > MAX_CHUNK) return 0;
+    if (align <= ALIGNMENT) return malloc_chunk(chunk);
+    return aligned_malloc(chunk, align);
 }
 
-void mm_free(void *) {}
+void *mm_aligned_alloc(uint align, uint size) {
+    return mm_memalign(align, size);
+}
 
 void *mm_realloc(void *ptr, uint size) {
     if (size == 0) return mm_free(ptr), (void *)0;
     if (ptr == 0) return mm_malloc(size);
-    return 0;
+    size_t chunk = chunk_size(size);
+    if (chunk == 0) return 0;
+    return realloc_pack(list_pack(ptr), chunk);
+}
+
+/**
+ * size must be the size ptr was allocated with by mm_malloc
+ * or mm_calloc, or last resized to by mm_realloc, which keeps
+ * every chunk in the class of its size. The class then comes
+ * from size alone, not from the header. Free mm_memalign
+ * results with mm_free: they may sit in a larger class.
+ */
+void mm_free_sized(void *ptr, uint size) {
+    if (ptr == 0) return;
+    size_t chunk = ALIGN((size_t)size) + sizeof(struct pack);
+    if (chunk <= FAST_CHUNK)
+        return fast_deallocate(list_pack(ptr));
+    else if (chunk <= HUGE_MAX)
+        return free_pack(list_pack(ptr));
+    else
+        return pack_deallocate(list_pack(ptr));
+}
+
+/* Peak memory taken from the kernel since mm_init. */
+uint mm_peak_footprint(void) {
+    return usage.peak;
+}
+
+/* Entry points of mm_malloc_fixed and mm_free_fixed. */
+
+void *mm_malloc_fast(void) {
+    return malloc_fast();
+}
+
+void *mm_malloc_tiny(uint chunk) {
+    size_t index = tiny_index(chunk);
+    void *data = tiny_allocate(index);
+    if (data != 0) return data;
+    return next_allocate(index, class_size[index]);
+}
+
+/* Only for mm_malloc_fixed chunks of the class; see ummalloc.h. */
+
+void mm_free_fast(void *ptr) {
+    if (ptr == 0) return;
+    fast_deallocate(list_pack(ptr));
+}
+
+void mm_free_small(void *ptr) {
+    if (ptr == 0) return;
+    free_pack(list_pack(ptr));
+}
+
+uint mm_usable_size(void *ptr) {
+    if (ptr == 0) return 0;
+    return pack_usable(list_pack(ptr));
+}
+
+int mm_malloc_batch(uint size, int n, void **out) {
+    size_t chunk = chunk_size(size);
+    if (n <= 0 || chunk == 0) return 0;
+    return malloc_batch(chunk, n, out);
+}
+
+void mm_free_batch(void **ptrs, int n) {
+    if (n <= 0) return;
+    free_batch(ptrs, n);
+}
+
+/**
+ * Heaps other than the default one. A heap over a region
+ * keeps its state at the start of the region and never
+ * leaves it. Without a region, the heap maps size bytes,
+ * and maps more in steps of that size when it runs out.
+ */
+
+struct heap *mm_heap_create(void *region, uint size) {
+    grow_t grow = grow_fixed;
+    if (size < sizeof(struct heap) + 2 * PAGE_SIZE) return 0;
+    if (region == 0) {
+        size = (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+        region = mmap(0, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS);
+        if (region == (void *)-1) return 0;
+        usage_map(size);
+        grow = grow_mmap;
+    }
+
+    struct heap *h = (struct heap *)ALIGN((size_t)region);
+    h->grow = grow;
+    h->brk  = (size_t)(h + 1);
+    h->end  = (size_t)region + size;
+    h->step = size;
+
+    struct heap *prev = heap;
+    heap = h;
+    int ret = mm_init();
+    if (grow == grow_fixed) h->fresh = h->end; // Not zeroed by us.
+    heap = prev;
+    return ret == -1 ? 0 : h;
+}
+
+void *mm_heap_malloc(struct heap *h, uint size) {
+    struct heap *prev = heap;
+    heap = h;
+    void *data = mm_malloc(size);
+    heap = prev;
+    return data;
+}
+
+void mm_heap_free(struct heap *h, void *ptr) {
+    struct heap *prev = heap;
+    heap = h;
+    mm_free(ptr);
+    heap = prev;
+}
+
+void *mm_heap_calloc(struct heap *h, uint count, uint size) {
+    struct heap *prev = heap;
+    heap = h;
+    void *data = mm_calloc(count, size);
+    heap = prev;
+    return data;
+}
+
+void *mm_heap_realloc(struct heap *h, void *ptr, uint size) {
+    struct heap *prev = heap;
+    heap = h;
+    void *data = mm_realloc(ptr, size);
+    heap = prev;
+    return data;
+}
+
+/**
+ * Arenas. Blocks come from the default heap, or from h for
+ * mm_heap_arena_create. size is the chunk size of a block,
+ * or 0 for ARENA_SIZE.
+ */
+
+struct arena *mm_arena_create(uint size) {
+    if (size == 0) size = ARENA_SIZE;
+    size = ALIGN(size);
+    if (size < 1024) return 0;
+
+    struct arena *arena = mm_malloc(sizeof(struct arena));
+    if (arena == 0) return 0;
+    arena->ptr = arena->end = 0;
+    arena->used = arena->spare = 0;
+    arena->size = size;
+    arena->heap = heap;
+    return arena;
+}
+
+struct arena *mm_heap_arena_create(struct heap *h, uint size) {
+    struct heap *prev = heap;
+    heap = h;
+    struct arena *arena = mm_arena_create(size);
+    heap = prev;
+    return arena;
+}
+
+void *mm_arena_alloc(struct arena *arena, uint size) {
+    return arena_alloc(arena, size);
+}
+
+void mm_arena_reset(struct arena *arena) {
+    arena_reset(arena);
+}
+
+void mm_arena_destroy(struct arena *arena) {
+    if (arena == 0) return;
+    block_release(arena, arena->used);
+    block_release(arena, arena->spare);
+
+    struct heap *prev = heap;
+    heap = arena->heap;
+    mm_free(arena);
+    heap = prev;
+}
+
+/**
+ * malloc and free for all user programs.
+ * The heap is set up on first use. A later mm_init (as
+ * in ummalloc_test) starts a new heap, and memory from
+ * the old heap must not be freed after that.
+ */
+
+void *malloc(uint size) {
+    if (main_heap.base == 0 && mm_init() == -1) return 0;
+    return mm_malloc(size);
+}
+
+void free(void *ptr) {
+    return mm_free(ptr);
 }
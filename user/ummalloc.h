@@ -1,4 +1,61 @@
+#include "../memory/ummalloc_decl.h"
+
 extern int mm_init(void);
 extern void *mm_malloc(uint size);
 extern void mm_free(void *ptr);
+extern void *mm_calloc(uint count, uint size);
+extern void *mm_memalign(uint align, uint size);
+extern void *mm_aligned_alloc(uint align, uint size);
 extern void *mm_realloc(void *ptr, uint size);
+extern int mm_malloc_batch(uint size, int n, void **out);
+extern void mm_free_batch(void **ptrs, int n);
+extern void mm_free_sized(void *ptr, uint size);
+extern uint mm_usable_size(void *ptr);
+extern uint mm_peak_footprint(void);
+
+struct heap;
+extern struct heap *mm_heap_create(void *region, uint size);
+extern void *mm_heap_malloc(struct heap *h, uint size);
+extern void mm_heap_free(struct heap *h, void *ptr);
+extern void *mm_heap_calloc(struct heap *h, uint count, uint size);
+extern void *mm_heap_realloc(struct heap *h, void *ptr, uint size);
+
+struct arena;
+extern struct arena *mm_arena_create(uint size);
+extern struct arena *mm_heap_arena_create(struct heap *h, uint size);
+extern void *mm_arena_alloc(struct arena *arena, uint size);
+extern void mm_arena_reset(struct arena *arena);
+extern void mm_arena_destroy(struct arena *arena);
+
+extern void *mm_malloc_fast(void);
+extern void *mm_malloc_tiny(uint chunk);
+extern void mm_free_fast(void *ptr);
+extern void mm_free_small(void *ptr);
+
+/**
+ * Allocation with a size known at compile time, such as
+ * mm_malloc_fixed(sizeof(struct foo)). The size class is
+ * worked out by the compiler from the bounds in
+ * ummalloc_decl.h, so only the slot path is left at run
+ * time. mm_free_fixed takes only a pointer from
+ * mm_malloc_fixed of the same size, and trusts the size
+ * to pick the class without reading the chunk header.
+ */
+#define MM_CHUNK(size) (ALIGN((size_t)(size)) + 8) // 8: chunk header
+
+static inline void *mm_malloc_fixed(uint size) {
+    if (MM_CHUNK(size) <= FAST_CHUNK)
+        return mm_malloc_fast();
+    if (MM_CHUNK(size) <= TINY_MAX)
+        return mm_malloc_tiny(MM_CHUNK(size));
+    return mm_malloc(size);
+}
+
+static inline void mm_free_fixed(void *ptr, uint size) {
+    if (MM_CHUNK(size) <= FAST_CHUNK)
+        mm_free_fast(ptr);
+    else if (MM_CHUNK(size) <= HUGE_MAX)
+        mm_free_small(ptr);
+    else
+        mm_free(ptr);
+}
@@ -157,6 +157,7 @@ int main(int argc, char* argv[]) {
         ptr[id] = mm_realloc(old_ptr, size);
         if (size && ptr[id] == 0) {
           printf("heap used : %d bytes\n", (void*)sbrk(0) - begin_heap_top);
+          printf("peak footprint : %d bytes\n", mm_peak_footprint());
           lib_err("realloc");
         }
         memcheck(ptr[id], i & 0xFF, min_size);
@@ -171,6 +172,8 @@ int main(int argc, char* argv[]) {
   uint finish_clk = getclk();
   void* finish_heap_top = sbrk(0);
   printf("heap used : %d bytes\n", finish_heap_top - begin_heap_top);
+  // trimming the heap at the end must not hide the peak.
+  printf("peak footprint : %d bytes\n", mm_peak_footprint());
   printf("time : %l\n", finish_clk - begin_clk);
   exit(0);
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 struct stat;
+struct shmid_ds;
 
 // system calls
 int fork(void);
@@ -24,6 +25,14 @@ char* sbrk(int);
 int sleep(int);
 int uptime(void);
 uint64 getclk(void);
+void* mmap(void*, uint64, int, int);
+int munmap(void*, uint64);
+int madvise(void*, uint64, int);
+void* mremap(void*, uint64, uint64, int);
+int shmget(int, uint64, int);
+void* shmat(int, void*, int);
+int shmdt(void*);
+int shmctl(int, int, struct shmid_ds*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -37,3 +37,11 @@ entry("sbrk");
 entry("sleep");
 entry("uptime");
 entry("getclk");
+entry("mmap");
+entry("munmap");
+entry("madvise");
+entry("mremap");
+entry("shmget");
+entry("shmat");
+entry("shmdt");
+entry("shmctl");